@@ -0,0 +1,49 @@
+# Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generate the IFUNC forwarders for the driver API entry points listed in
+# list_file, one per line with blank lines and # comments ignored, as a
+# list of AUTOCOMPAT_FORWARD(<index>, <name>) invocations written to output
+# along with their count, AUTOCOMPAT_FORWARD_COUNT
+function(generate_driver_api_forwarders list_file output)
+    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS
+        ${list_file}
+    )
+    file(STRINGS ${list_file} lines)
+
+    set(names)
+    set(entries)
+    foreach(line IN LISTS lines)
+        string(STRIP "${line}" line)
+        if (line STREQUAL "" OR line MATCHES [[^#]])
+            continue()
+        endif()
+        if (NOT line MATCHES [[^cu[A-Za-z0-9_]+$]])
+            message(FATAL_ERROR "${list_file}: Invalid entry point: ${line}")
+        endif()
+        if (line IN_LIST names)
+            message(FATAL_ERROR "${list_file}: Duplicate entry point: ${line}")
+        endif()
+        list(LENGTH names index)
+        list(APPEND names ${line})
+        string(APPEND entries "AUTOCOMPAT_FORWARD(${index}, ${line})\n")
+    endforeach()
+
+    list(LENGTH names count)
+    set(content "// Generated from ${list_file}; do not edit\n")
+    string(APPEND content "#define AUTOCOMPAT_FORWARD_COUNT ${count}\n")
+    string(APPEND content "#ifdef AUTOCOMPAT_FORWARD\n${entries}#endif\n")
+    message(STATUS "Forwarding ${count} driver API entry points")
+    file(CONFIGURE OUTPUT ${output} CONTENT "${content}" @ONLY)
+endfunction()
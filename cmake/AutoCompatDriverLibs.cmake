@@ -0,0 +1,147 @@
+# Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# The libraries shipped with the driver that the loader libraries redirect to
+# the selected driver directory, as pairs of enumerator name and soname.  The
+# first AUTOCOMPAT_DRIVER_LIBS_REQUIRED are present in every driver and CUDA
+# compat directory and are reported by the search helper; see
+# search_protocol.h.  The rest are only redirected when the selected
+# directory has them.
+set(AUTOCOMPAT_DRIVER_LIBS
+    LIBCUDA libcuda.so.1
+    NVVM libnvidia-nvvm.so.4
+    PTXJITCOMPILER libnvidia-ptxjitcompiler.so.1
+    CUDADEBUGGER libcudadebugger.so.1
+    NVML libnvidia-ml.so.1
+    OPTICALFLOW libnvidia-opticalflow.so.1
+    OPTIX libnvoptix.so.1
+    NVCUVID libnvcuvid.so.1
+    NVENCODE libnvidia-encode.so.1
+)
+set(AUTOCOMPAT_DRIVER_LIBS_REQUIRED 4)
+
+# Byte value of the character at pos in str
+function(_driver_lib_char str pos out_var)
+    string(SUBSTRING "${str}" ${pos} 1 c)
+    string(HEX "${c}" hex)
+    math(EXPR ${out_var} "0x${hex}")
+    return(PROPAGATE ${out_var})
+endfunction()
+
+# Find a perfect hash of the form
+#
+#   (len * mul + name[pos]) & (size - 1)
+#
+# for the sonames, with size the smallest power of two at least twice the
+# number of sonames
+function(_driver_lib_find_hash sonames out_size out_mul out_pos)
+    list(LENGTH sonames count)
+    math(EXPR min_size "2 * ${count}")
+    set(size 1)
+    while (size LESS min_size)
+        math(EXPR size "${size} * 2")
+    endwhile()
+
+    set(min_len 4096)
+    foreach(soname IN LISTS sonames)
+        string(LENGTH "${soname}" len)
+        if (len LESS min_len)
+            set(min_len ${len})
+        endif()
+    endforeach()
+
+    # Every soname starts with "lib" so there's nothing to gain from those
+    math(EXPR max_pos "${min_len} - 1")
+    foreach(pos RANGE 3 ${max_pos})
+        foreach(mul RANGE 1 31)
+            set(used)
+            set(ok TRUE)
+            foreach(soname IN LISTS sonames)
+                string(LENGTH "${soname}" len)
+                _driver_lib_char("${soname}" ${pos} c)
+                math(EXPR h "(${len} * ${mul} + ${c}) & (${size} - 1)")
+                if (h IN_LIST used)
+                    set(ok FALSE)
+                    break()
+                endif()
+                list(APPEND used ${h})
+            endforeach()
+            if (ok)
+                set(${out_size} ${size})
+                set(${out_mul} ${mul})
+                set(${out_pos} ${pos})
+                return(PROPAGATE ${out_size} ${out_mul} ${out_pos})
+            endif()
+        endforeach()
+    endforeach()
+    message(FATAL_ERROR "No perfect hash found for the driver libraries")
+endfunction()
+
+# Generate driver_libs.h from template for the AUTOCOMPAT_DRIVER_LIBS
+function(generate_driver_libs_header template output)
+    set(enumerators)
+    set(sonames)
+    set(soname_lens)
+    set(names)
+    set(soname_list)
+    set(min_len 4096)
+    set(max_len 0)
+    set(index 0)
+    list(LENGTH AUTOCOMPAT_DRIVER_LIBS num_fields)
+    math(EXPR last "${num_fields} - 1")
+    foreach(i RANGE 0 ${last} 2)
+        math(EXPR j "${i} + 1")
+        list(GET AUTOCOMPAT_DRIVER_LIBS ${i} name)
+        list(GET AUTOCOMPAT_DRIVER_LIBS ${j} soname)
+        string(LENGTH "${soname}" len)
+        if (len LESS min_len)
+            set(min_len ${len})
+        endif()
+        if (len GREATER max_len)
+            set(max_len ${len})
+        endif()
+        string(APPEND enumerators "    DRIVER_LIB_${name} = ${index},\n")
+        string(APPEND sonames "        \"${soname}\", \\\n")
+        string(APPEND soname_lens "        ${len}, \\\n")
+        list(APPEND names ${name})
+        list(APPEND soname_list ${soname})
+        math(EXPR index "${index} + 1")
+    endforeach()
+
+    _driver_lib_find_hash("${soname_list}" hash_size hash_mul hash_pos)
+
+    # Slots hold the driver_lib plus one so empty slots are zero
+    set(slots)
+    math(EXPR last_lib "${index} - 1")
+    foreach(lib RANGE 0 ${last_lib})
+        list(GET soname_list ${lib} soname)
+        list(GET names ${lib} name)
+        string(LENGTH "${soname}" len)
+        _driver_lib_char("${soname}" ${hash_pos} c)
+        math(EXPR h "(${len} * ${hash_mul} + ${c}) & (${hash_size} - 1)")
+        string(APPEND slots "        [${h}] = DRIVER_LIB_${name} + 1, \\\n")
+    endforeach()
+
+    set(DRIVER_LIB_ENUMERATORS "${enumerators}")
+    set(DRIVER_LIB_SONAMES "${sonames}")
+    set(DRIVER_LIB_SONAME_LENS "${soname_lens}")
+    set(DRIVER_LIB_HASH_SLOTS "${slots}")
+    set(DRIVER_LIB_REQUIRED_COUNT ${AUTOCOMPAT_DRIVER_LIBS_REQUIRED})
+    set(DRIVER_LIB_SONAME_MIN ${min_len})
+    set(DRIVER_LIB_SONAME_MAX ${max_len})
+    set(DRIVER_LIB_HASH_SIZE ${hash_size})
+    set(DRIVER_LIB_HASH_MUL ${hash_mul})
+    set(DRIVER_LIB_HASH_POS ${hash_pos})
+    configure_file(${template} ${output} @ONLY)
+endfunction()
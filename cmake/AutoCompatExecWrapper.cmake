@@ -40,7 +40,7 @@ elseif (OUTPUT_REGEX)
 endif()
 if (ERROR_QUIET)
     list(APPEND EP_OPTIONS ERROR_QUIET)
-elseif (ERROR_REGEX)
+elseif (ERROR_REGEX OR ERROR_NOT_REGEX)
     list(APPEND EP_OPTIONS
         ERROR_VARIABLE RESULT_ERROR
         ECHO_ERROR_VARIABLE
@@ -49,6 +49,10 @@ endif()
 
 set_environment(${ENVIRONMENT})
 
+if (CLEAN_DIR)
+    file(REMOVE_RECURSE ${CLEAN_DIR})
+endif()
+
 execute_process(
     ${EP_OPTIONS}
     RESULT_VARIABLE RESULT_RETURN
@@ -68,3 +72,7 @@ endif()
 if (ERROR_REGEX AND NOT (RESULT_ERROR MATCHES "${ERROR_REGEX}"))
     message(FATAL_ERROR "STDERR does not match ERROR_REGEX: ${ERROR_REGEX}")
 endif()
+
+if (ERROR_NOT_REGEX AND RESULT_ERROR MATCHES "${ERROR_NOT_REGEX}")
+    message(FATAL_ERROR "STDERR matches ERROR_NOT_REGEX: ${ERROR_NOT_REGEX}")
+endif()
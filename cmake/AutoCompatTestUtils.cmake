@@ -14,8 +14,10 @@
 
 function(add_wrapped_test)
     set(options OUTPUT_QUIET ERROR_QUIET WILL_FAIL)
-    set(oneValueArgs NAME INPUT_FILE)
-    set(multiValueArgs ENVIRONMENT COMMAND OUTPUT_REGEX ERROR_REGEX)
+    set(oneValueArgs NAME INPUT_FILE CLEAN_DIR)
+    set(multiValueArgs
+        ENVIRONMENT COMMAND OUTPUT_REGEX ERROR_REGEX ERROR_NOT_REGEX
+    )
     cmake_parse_arguments(PARSE_ARGV 0 arg
         "${options}" "${oneValueArgs}" "${multiValueArgs}"
     )
@@ -29,8 +31,10 @@ function(add_wrapped_test)
     if (arg_OUTPUT_QUIET AND arg_OUTPUT_REGEX)
         message(FATAL_ERROR "OUTPUT_QUIET and OUTPUT_REGEX cannot both be set")
     endif()
-    if (arg_ERROR_QUIET AND arg_ERROR_REGEX)
-        message(FATAL_ERROR "ERROR_QUIET and ERROR_REGEX cannot both be set")
+    if (arg_ERROR_QUIET AND (arg_ERROR_REGEX OR arg_ERROR_NOT_REGEX))
+        message(FATAL_ERROR
+            "ERROR_QUIET and ERROR_REGEX or ERROR_NOT_REGEX cannot both be set"
+        )
     endif()
 
     set(exec_args -DLIST_SEPARATOR=,)
@@ -47,8 +51,16 @@ function(add_wrapped_test)
     endif()
     if (arg_ERROR_QUIET)
         list(APPEND exec_args -DERROR_QUIET=TRUE)
-    elseif (arg_ERROR_REGEX)
-        list(APPEND exec_args -DERROR_REGEX=${arg_ERROR_REGEX})
+    else()
+        if (arg_ERROR_REGEX)
+            list(APPEND exec_args -DERROR_REGEX=${arg_ERROR_REGEX})
+        endif()
+        if (arg_ERROR_NOT_REGEX)
+            list(APPEND exec_args -DERROR_NOT_REGEX=${arg_ERROR_NOT_REGEX})
+        endif()
+    endif()
+    if (arg_CLEAN_DIR)
+        list(APPEND exec_args -DCLEAN_DIR=${arg_CLEAN_DIR})
     endif()
     if (arg_ENVIRONMENT)
         list(JOIN arg_ENVIRONMENT "," arg_ENVIRONMENT)
@@ -71,9 +83,13 @@ function(add_wrapped_test)
 endfunction()
 
 function(add_autocompat_search_test)
-    set(options WILL_FAIL)
-    set(oneValueArgs NAME INPUT_FILE CUDA_HOME VERBOSE)
-    set(multiValueArgs PATHS LIBRARIES OUTPUT_REGEX ERROR_REGEX)
+    set(options WILL_FAIL KEEP_STATE)
+    set(oneValueArgs
+        NAME INPUT_FILE CUDA_HOME VERBOSE STATE_DIR CONFIG SYSROOT
+    )
+    set(multiValueArgs
+        PATHS LIBRARIES ARGS ENVIRONMENT OUTPUT_REGEX ERROR_REGEX
+    )
     cmake_parse_arguments(PARSE_ARGV 0 arg
         "${options}" "${oneValueArgs}" "${multiValueArgs}"
     )
@@ -88,7 +104,7 @@ function(add_autocompat_search_test)
     endif()
 
     if (arg_OUTPUT_REGEX)
-        list(APPEND wrapped_args OUTPUT_REGEX ${OUTPUT_REGEX})
+        list(APPEND wrapped_args OUTPUT_REGEX ${arg_OUTPUT_REGEX})
     elseif (NOT arg_WILL_FAIL)
         # Try to infer the pasing output path
         if (arg_PATHS AND NOT arg_LIBRARIES)
@@ -125,6 +141,34 @@ function(add_autocompat_search_test)
         list(APPEND env CUDA_AUTOCOMPAT_VERBOSE=2)
     endif()
 
+    # Ignore any admin configuration installed on the host
+    list(APPEND env CUDA_AUTOCOMPAT_CONFIG=${arg_CONFIG})
+
+    # Likewise for the host's kernel module, which the stub drivers would
+    # never match
+    if (NOT arg_SYSROOT)
+        set(arg_SYSROOT ${CMAKE_CURRENT_BINARY_DIR}/sysroot/none)
+    endif()
+    list(APPEND env CUDA_AUTOCOMPAT_SYSROOT=${arg_SYSROOT})
+
+    # Keep state from previous runs isolated to each test unless shared
+    # explicitly, and start from a clean slate unless the test is meant to
+    # pick up where an earlier one left off
+    if (NOT arg_STATE_DIR)
+        set(arg_STATE_DIR ${CMAKE_CURRENT_BINARY_DIR}/state/${arg_NAME})
+    endif()
+    if (NOT arg_KEEP_STATE)
+        list(APPEND wrapped_args CLEAN_DIR ${arg_STATE_DIR})
+    endif()
+    list(APPEND env CUDA_AUTOCOMPAT_STATE_DIR=${arg_STATE_DIR})
+
+    # Metrics are kept with the rest of the test's state rather than counted
+    # in the node's
+    list(APPEND env CUDA_AUTOCOMPAT_METRICS_DIR=${arg_STATE_DIR})
+    if (arg_ENVIRONMENT)
+        list(APPEND env ${arg_ENVIRONMENT})
+    endif()
+
     list(APPEND wrapped_args ENVIRONMENT "${env}")
 
     set(exe $<TARGET_FILE:autocompat_search>)
@@ -136,6 +180,9 @@ function(add_autocompat_search_test)
         list(JOIN arg_LIBRARIES ":" arg_LIBRARIES)
         list(APPEND exe -l "${arg_LIBRARIES}")
     endif()
+    if (arg_ARGS)
+        list(APPEND exe ${arg_ARGS})
+    endif()
     if (arg_INPUT_FILE)
         list(APPEND exe -)
     endif()
@@ -13,6 +13,7 @@
  * limitations under the License.
  */
 #include <cstdlib>
+#include <unistd.h>
 
 #include <filesystem>
 #include <functional>
@@ -22,10 +23,9 @@
 #include "dl_library.h"
 #include "logging.h"
 
+// Any arguments are a command to exec afterwards, i.e. to check what the
+// driver search leaves for child processes
 int main(int argc, char **argv) {
-    (void)argc;
-    (void)argv;
-
     using namespace autocompat;
 
     LOGGING_MAX_LEVEL = log_level::info;
@@ -92,5 +92,11 @@ int main(int argc, char **argv) {
     ret = cuInit(0);
     log_cuError(ret);
 
+    if (argc > 1) {
+        execvp(argv[1], argv + 1);
+        log_info("exec {} failed", argv[1]);
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
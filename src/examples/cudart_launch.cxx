@@ -0,0 +1,63 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measure how long an application linked directly against libcudart waits
+// for the driver.  An optional argument gives a number of milliseconds of
+// simulated startup work, i.e. reading input and setting up MPI, to do
+// before the first CUDA call.
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "logging.h"
+
+extern "C" int cudaDriverGetVersion(int *ver);
+
+int main(int argc, char **argv) {
+    using namespace autocompat;
+    using clock = std::chrono::steady_clock;
+
+    LOGGING_MAX_LEVEL = log_level::info;
+    LOGGING_USE_TIMESTAMP = false;
+    LOGGING_USE_LOG_NAME = false;
+    LOGGING_USE_LEVEL_NAME = false;
+
+    const auto startup_work =
+        std::chrono::milliseconds(argc > 1 ? std::atoi(argv[1]) : 0);
+
+    const auto start = clock::now();
+    std::this_thread::sleep_for(startup_work);
+    const auto startup_done = clock::now();
+
+    int ver = -1;
+    const int ret = cudaDriverGetVersion(&ver);
+    const auto driver_done = clock::now();
+
+    auto to_ms = [](clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d)
+            .count();
+    };
+    log_info("startup work: {} ms", to_ms(startup_done - start));
+    log_info("cudaDriverGetVersion: {} ms", to_ms(driver_done - startup_done));
+    if (ret != 0) {
+        log_info("  ret = {}", ret);
+        return EXIT_FAILURE;
+    }
+    log_info("  ver = {}", ver);
+
+    return EXIT_SUCCESS;
+}
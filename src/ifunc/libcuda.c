@@ -13,132 +13,677 @@
  * limitations under the License.
  */
 
-#include <stdlib.h>
+// A drop-in libcuda.so.1 that locates the newest usable driver and forwards
+// the driver API to it.  Every entry point in driver_api.txt is exported as
+// a GNU IFUNC whose resolver returns the real driver's function, so once the
+// dynamic linker binds a call it goes straight into the driver without a
+// wrapper frame.
+//
+// Resolvers can also run before this library's constructor, i.e. during
+// startup relocation for applications linked with -z now, when the C library
+// isn't initialized yet and neither the search nor dlopen can be used, as
+// well as while the driver itself is being loaded.  Those resolve to a small
+// per-entry trampoline instead, which jumps through a slot
+// filled in with the driver's entry point on its first call.
+//
+// With CUDA_AUTOCOMPAT_LAZY set, every entry point starts out bound to its
+// trampoline and the search and driver load are deferred from the
+// constructor to the first driver API call, so processes that never use the
+// GPU, i.e. for --help or an import-time-only Python module, never pay for
+// them.  Without a usable driver the entry points then return
+// CUDA_ERROR_NO_DEVICE rather than the process exiting at startup.
+//
+// With CUDA_AUTOCOMPAT_HUGE_TEXT set the driver's text is moved onto huge
+// pages as soon as it's loaded; see huge_text.h.
+//
+// cuGetProcAddress and cuGetProcAddress_v2, which the runtime fetches
+// nearly every other entry point through, are real functions memoizing the
+// driver's answers instead; see proc_address_cache.h.
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dynamic_symbol.h"
+#include "huge_text.h"
+#include "metrics.h"
+#include "proc_address_cache.h"
+#include "resolved_token.h"
+#include "search_protocol.h"
+#include "search_helper.h"
+#include "visibility.h"
+
+// The CUresults used by the shim itself
+#define CUDA_SUCCESS 0
+#define CUDA_ERROR_INVALID_VALUE 1
+#define CUDA_ERROR_NO_DEVICE 100
+#define CUDA_ERROR_NOT_FOUND 500
+
+#define AUTOCOMPAT_LAZY_ENV "CUDA_AUTOCOMPAT_LAZY"
+
+typedef int (*get_proc_address_fn)(const char *, void **, int, uint64_t);
+typedef int (*get_proc_address_v2_fn)(const char *, void **, int, uint64_t,
+                                      int *);
+
+static search_results results;
+
+// The search result the driver libraries were loaded from
+static const search_result *loaded_result = NULL;
+
+static void *libcuda_handle = NULL;
+static void *libnvidia_nvvm_handle = NULL;
+static void *libnvidia_ptxjitcompiler_handle = NULL;
+
+static get_proc_address_fn driver_get_proc_address = NULL;
+static get_proc_address_v2_fn driver_get_proc_address_v2 = NULL;
+
+static pthread_once_t load_once = PTHREAD_ONCE_INIT;
+static pthread_once_t nvvm_once = PTHREAD_ONCE_INIT;
+static pthread_once_t ptxjitcompiler_once = PTHREAD_ONCE_INIT;
+
+// Set while this thread is loading the driver, whose own relocations can
+// call back into the resolvers below
+static __thread bool loading_driver = false;
+
+static void unload_driver_libs(void);
+
+// Load a sibling library of libcuda.so.1 into the global scope so the
+// driver's own dlopen of it by soname finds it rather than searching.  The
+// driver only needs these for JIT compilation so failing to load one isn't
+// fatal.
+static void *load_sibling_lib(const search_result *result, driver_lib lib) {
+    void *handle = dlopen(result->paths[lib], RTLD_LAZY | RTLD_GLOBAL);
+    if (!handle) {
+        fprintf(stderr, "warning: Failed to load %s: %s\n",
+                driver_lib_sonames[lib], dlerror());
+    }
+    return handle;
+}
 
-#include "common/api.h"
-#include "common/autocompat.h"
-#include "common/logging.h"
+static void load_nvvm(void) {
+    libnvidia_nvvm_handle = load_sibling_lib(loaded_result, DRIVER_LIB_NVVM);
+}
 
-void *libcuda_handle = NULL;
-void *libnvidia_nvvm_handle = NULL;
-void *libnvidia_ptxjitcompiler_handle = NULL;
-void *libcudadebugger_handle = NULL;
+static void load_ptxjitcompiler(void) {
+    libnvidia_ptxjitcompiler_handle =
+        load_sibling_lib(loaded_result, DRIVER_LIB_PTXJITCOMPILER);
+}
 
-int load_driver_libs(void) {
-    LOG_INFO("Loading driver libs");
-    int ret = 0;
+// Stands in for dlopen in the driver's own calls so the JIT libraries, which
+// are tens of megabytes each and unused by applications that only load
+// cubins, are loaded from the selected driver's directory when it first
+// asks for them rather than up front
+static void *driver_dlopen(const char *file, int mode) {
+    const char *name = file ? strrchr(file, '/') : NULL;
+    name = name ? name + 1 : file;
+    if (name && strcmp(name, driver_lib_sonames[DRIVER_LIB_NVVM]) == 0) {
+        (void)pthread_once(&nvvm_once, load_nvvm);
+    } else if (name && strcmp(name, driver_lib_sonames
+                                        [DRIVER_LIB_PTXJITCOMPILER]) == 0) {
+        (void)pthread_once(&ptxjitcompiler_once, load_ptxjitcompiler);
+    }
+    return dlopen(file, mode);
+}
 
-    LOG_VERBOSE("%s", libcuda_path);
-    LOG_TRACE("dlopen(%s)", libcuda_path);
-    libcuda_handle = dlopen(libcuda_path, RTLD_LAZY | RTLD_GLOBAL);
+// Load the driver libraries for a single ranked search result
+static bool load_result_libs(const search_result *result) {
+    libcuda_handle =
+        dlopen(result->paths[DRIVER_LIB_LIBCUDA], RTLD_LAZY | RTLD_GLOBAL);
     if (!libcuda_handle) {
-        LOG_ERROR("Error loading %s: %s", LIBCUDA_SONAME, dlerror());
-        ret = 1;
+        fprintf(stderr, "error: Failed to load %s: %s\n",
+                result->paths[DRIVER_LIB_LIBCUDA], dlerror());
+        return false;
     }
 
-    LOG_VERBOSE("%s", libnvidia_nvvm_path);
-    LOG_TRACE("dlopen(%s)", libnvidia_nvvm_path);
-    libnvidia_nvvm_handle =
-        dlopen(libnvidia_nvvm_path, RTLD_LAZY | RTLD_GLOBAL);
-    if (!libnvidia_nvvm_handle) {
-        LOG_ERROR("Error loading %s: %s", LIBNVIDIA_NVVM_SONAME, dlerror());
-        ret = 1;
+    struct link_map *map = NULL;
+    if (dlinfo(libcuda_handle, RTLD_DI_LINKMAP, &map) != 0) {
+        map = NULL;
     }
 
-    LOG_VERBOSE("%s", libnvidia_ptxjitcompiler_path);
-    LOG_TRACE("dlopen(%s)", libnvidia_ptxjitcompiler_path);
-    libnvidia_ptxjitcompiler_handle =
-        dlopen(libnvidia_ptxjitcompiler_path, RTLD_LAZY | RTLD_GLOBAL);
-    if (!libnvidia_ptxjitcompiler_handle) {
-        LOG_ERROR("Error loading %s: %s", LIBNVIDIA_PTXJITCOMPILER_SONAME,
-                  dlerror());
-        ret = 1;
+    // Nothing can be running the driver's code yet since none of its entry
+    // points have been handed out
+    if (map && huge_text_requested()) {
+        (void)remap_text_huge(map);
     }
 
-    /*
-    libcudadebugger_handle = dlopen(libcuda_path, RTLD_LAZY | RTLD_GLOBAL);
-    if (!libcudadebugger_handle) {
-        LOG_ERROR("Error loading %s: %s", LIBCUDADEBUGGER_SONAME, dlerror());
-        ret = 1;
+    // Without a dlopen import to hook, i.e. on an unsupported architecture,
+    // the JIT libraries have to be loaded now
+    void *hook = NULL;
+    void *(*hook_fn)(const char *, int) = driver_dlopen;
+    (void)memcpy(&hook, &hook_fn, sizeof(hook));
+    if (!map || redirect_dynamic_import(map, "dlopen", hook) == 0) {
+        libnvidia_nvvm_handle = load_sibling_lib(result, DRIVER_LIB_NVVM);
+        libnvidia_ptxjitcompiler_handle =
+            load_sibling_lib(result, DRIVER_LIB_PTXJITCOMPILER);
     }
-    */
 
-    return ret;
+    void *sym = dlsym(libcuda_handle, "cuGetProcAddress");
+    (void)memcpy(&driver_get_proc_address, &sym, sizeof(sym));
+    sym = dlsym(libcuda_handle, "cuGetProcAddress_v2");
+    (void)memcpy(&driver_get_proc_address_v2, &sym, sizeof(sym));
+    return true;
 }
 
-int unload_driver_libs(void) {
-    LOG_INFO("Unloading driver libs");
-    int ret = 0;
-    if (libcudadebugger_handle) {
-        LOG_TRACE("dlclose(libcudadebugger)");
-        if (dlclose(libcudadebugger_handle) != 0) {
-            LOG_ERROR("Error closing %s: %s", LIBCUDADEBUGGER_SONAME,
-                      dlerror());
-            ret = 1;
+static void find_and_load_driver_libs(void) {
+    // The helper loads this library to check whether it's a real driver
+    if (secure_getenv(AUTOCOMPAT_HELPER_ENV)) {
+        return;
+    }
+
+    const uint64_t start_us = autocompat_metrics_now_us();
+    const int count = find_libcuda(&results);
+    autocompat_metrics_record_resolution(
+        AUTOCOMPAT_METRICS_IFUNC,
+        count > 0 ? results.outcome : AUTOCOMPAT_METRICS_FAILED,
+        count > 0 ? results.entries[0].version : 0,
+        autocompat_metrics_now_us() - start_us);
+    if (count == 0) {
+        fputs("error: Failed to locate a usable libcuda.so.1\n", stderr);
+        return;
+    }
+
+    // The search results are ranked so if the best driver can't be loaded,
+    // i.e. it was removed or replaced since the search, fall back to the next
+    // one rather than failing or searching again
+    for (int i = 0; i < results.count; ++i) {
+        if (load_result_libs(&results.entries[i])) {
+            loaded_result = &results.entries[i];
+            return;
         }
-        libcudadebugger_handle = NULL;
-    }
-    if (libnvidia_ptxjitcompiler_handle) {
-        LOG_TRACE("dlclose(libnvidia_ptxjitcompiler)");
-        if (dlclose(libnvidia_ptxjitcompiler_handle) != 0) {
-            LOG_ERROR("Error closing %s: %s", LIBNVIDIA_PTXJITCOMPILER_SONAME,
-                      dlerror());
-            ret = 1;
+        unload_driver_libs();
+        if (i + 1 < results.count) {
+            fprintf(stderr, "warning: Falling back to %s\n",
+                    results.entries[i + 1].paths[DRIVER_LIB_LIBCUDA]);
         }
-        libnvidia_ptxjitcompiler_handle = NULL;
     }
-    if (libnvidia_nvvm_handle) {
-        LOG_TRACE("dlclose(libnvidia_nvvm)");
-        if (dlclose(libnvidia_nvvm_handle) != 0) {
-            LOG_ERROR("Error closing %s: %s", LIBNVIDIA_NVVM_SONAME, dlerror());
-            ret = 1;
-        }
-        libnvidia_nvvm_handle = NULL;
+}
+
+// Whether loading the driver has finished, successfully or not
+static bool driver_load_done = false;
+
+static void load_driver_libs(void) {
+    loading_driver = true;
+    find_and_load_driver_libs();
+    loading_driver = false;
+    __atomic_store_n(&driver_load_done, true, __ATOMIC_RELEASE);
+}
+
+static void close_handle(void **handle) {
+    if (*handle && dlclose(*handle) != 0) {
+        fprintf(stderr, "warning: %s\n", dlerror());
     }
-    if (libcuda_handle) {
-        LOG_TRACE("dlclose(libcuda)");
-        if (dlclose(libcuda_handle) != 0) {
-            LOG_ERROR("Error closing %s: %s", LIBCUDA_SONAME, dlerror());
-            ret = 1;
-        }
-        libcuda_handle = NULL;
+    *handle = NULL;
+}
+
+static void unload_driver_libs(void) {
+    driver_get_proc_address = NULL;
+    driver_get_proc_address_v2 = NULL;
+    close_handle(&libnvidia_ptxjitcompiler_handle);
+    close_handle(&libnvidia_nvvm_handle);
+    close_handle(&libcuda_handle);
+}
+
+typedef void (*driver_fn)(void);
+
+static int entry_point_not_found(void) {
+    return CUDA_ERROR_NOT_FOUND;
+}
+
+// Only reachable in lazy mode since the constructor exits otherwise
+static int entry_point_no_driver(void) {
+    return CUDA_ERROR_NO_DEVICE;
+}
+
+// Resolve an entry point in the selected driver, loading it first if need be
+static driver_fn resolve_driver_symbol(const char *name) {
+    (void)pthread_once(&load_once, load_driver_libs);
+
+    driver_fn fn = NULL;
+    void *sym = libcuda_handle ? dlsym(libcuda_handle, name) : NULL;
+    if (sym) {
+        (void)memcpy(&fn, &sym, sizeof(sym));
+    } else {
+        int (*not_found)(void) =
+            libcuda_handle ? entry_point_not_found : entry_point_no_driver;
+        (void)memcpy(&fn, &not_found, sizeof(fn));
     }
-    return ret;
+    return fn;
 }
 
-DLL_CONSTRUCTOR
-void libcuda_ctor(void) {
-    autocompat_init();
+#include "driver_api.inc"
+
+static const char *const forward_names[AUTOCOMPAT_FORWARD_COUNT] = {
+#define AUTOCOMPAT_FORWARD(index, name) [index] = #name,
+#include "driver_api.inc"
+#undef AUTOCOMPAT_FORWARD
+};
+
+// Whether the C library is initialized so resolvers can load the driver,
+// i.e. this library's constructor has started
+static bool resolvers_ready = false;
+
+// Whether the driver is only loaded on first use; set by the constructor
+static bool lazy_mode = false;
+
+// Whether a resolver has to defer to a trampoline rather than wait for the
+// driver to load, or in lazy mode load it
+static bool resolve_early(void) {
+    return !__atomic_load_n(&resolvers_ready, __ATOMIC_ACQUIRE) ||
+           loading_driver ||
+           (lazy_mode && !__atomic_load_n(&driver_load_done, __ATOMIC_ACQUIRE));
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+    #define AUTOCOMPAT_HAVE_TRAMPOLINES 1
+#else
+    #define AUTOCOMPAT_HAVE_TRAMPOLINES 0
+#endif
+
+#if AUTOCOMPAT_HAVE_TRAMPOLINES
+
+// The driver entry point each trampoline jumps to, or NULL until its first
+// call resolves it
+DLL_PRIVATE driver_fn autocompat_forward_slots[AUTOCOMPAT_FORWARD_COUNT];
+
+// Whether any resolver has handed out a trampoline
+static bool trampolines_used = false;
+
+static pthread_once_t rebind_once = PTHREAD_ONCE_INIT;
+static void rebind_trampolines(void);
+
+static driver_fn fill_slot(int index) {
+    driver_fn fn = resolve_driver_symbol(forward_names[index]);
+    __atomic_store_n(&autocompat_forward_slots[index], fn, __ATOMIC_RELEASE);
+    return fn;
+}
+
+// Called by the trampolines' common slow path with the caller's argument
+// registers preserved
+DLL_PRIVATE driver_fn autocompat_resolve_slot(int index) {
+    driver_fn fn = fill_slot(index);
+    (void)pthread_once(&rebind_once, rebind_trampolines);
+    return fn;
+}
+
+// Each trampoline jumps through its slot if it's set and otherwise passes
+// its index to the slow path, which saves every register that can hold an
+// argument, resolves the slot, and tail calls the result.  The landing pad
+// at each entry is needed since they're reached through the PLT.
+    #if defined(__x86_64__)
+        #define AUTOCOMPAT_TRAMPOLINE_BODY(index)                              \
+            "endbr64\n"                                                        \
+            "movq autocompat_forward_slots+8*" #index "(%rip), %r11\n"         \
+            "testq %r11, %r11\n"                                               \
+            "jz 1f\n"                                                          \
+            "jmpq *%r11\n"                                                     \
+            "1:\n"                                                             \
+            "movl $" #index ", %r11d\n"                                        \
+            "jmp autocompat_forward_slow\n"
 
-    LOG_INFO("CUDA AutoCompat v%d.%d.%d (libcuda IFUNC interface)",
-             CUDA_AUTOCOMPAT_VERSION_MAJOR, CUDA_AUTOCOMPAT_VERSION_MINOR,
-             CUDA_AUTOCOMPAT_VERSION_PATCH);
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".type autocompat_forward_slow, @function\n"
+        "autocompat_forward_slow:\n"
+        "pushq %rbp\n"
+        "movq %rsp, %rbp\n"
+        "pushq %rax\n"
+        "pushq %rdi\n"
+        "pushq %rsi\n"
+        "pushq %rdx\n"
+        "pushq %rcx\n"
+        "pushq %r8\n"
+        "pushq %r9\n"
+        "pushq %r10\n"
+        "subq $128, %rsp\n"
+        "movdqu %xmm0, 0(%rsp)\n"
+        "movdqu %xmm1, 16(%rsp)\n"
+        "movdqu %xmm2, 32(%rsp)\n"
+        "movdqu %xmm3, 48(%rsp)\n"
+        "movdqu %xmm4, 64(%rsp)\n"
+        "movdqu %xmm5, 80(%rsp)\n"
+        "movdqu %xmm6, 96(%rsp)\n"
+        "movdqu %xmm7, 112(%rsp)\n"
+        "movl %r11d, %edi\n"
+        "call autocompat_resolve_slot\n"
+        "movq %rax, %r11\n"
+        "movdqu 0(%rsp), %xmm0\n"
+        "movdqu 16(%rsp), %xmm1\n"
+        "movdqu 32(%rsp), %xmm2\n"
+        "movdqu 48(%rsp), %xmm3\n"
+        "movdqu 64(%rsp), %xmm4\n"
+        "movdqu 80(%rsp), %xmm5\n"
+        "movdqu 96(%rsp), %xmm6\n"
+        "movdqu 112(%rsp), %xmm7\n"
+        "addq $128, %rsp\n"
+        "popq %r10\n"
+        "popq %r9\n"
+        "popq %r8\n"
+        "popq %rcx\n"
+        "popq %rdx\n"
+        "popq %rsi\n"
+        "popq %rdi\n"
+        "popq %rax\n"
+        "popq %rbp\n"
+        "jmpq *%r11\n"
+        ".size autocompat_forward_slow, .-autocompat_forward_slow\n");
+    #elif defined(__aarch64__)
+        #define AUTOCOMPAT_TRAMPOLINE_BODY(index)                              \
+            "hint #34\n"                                                       \
+            "adrp x16, autocompat_forward_slots\n"                             \
+            "add x16, x16, :lo12:autocompat_forward_slots\n"                   \
+            "ldr x16, [x16, #(8*" #index ")]\n"                                \
+            "cbz x16, 1f\n"                                                    \
+            "br x16\n"                                                         \
+            "1:\n"                                                             \
+            "mov x17, #" #index "\n"                                           \
+            "b autocompat_forward_slow\n"
 
-    int ret = autocompat_search();
-    if (ret != 0) {
-        if (ret == 1) {
-            LOG_ERROR("No suitable %s found", LIBCUDA_SONAME);
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".type autocompat_forward_slow, %function\n"
+        "autocompat_forward_slow:\n"
+        "stp x29, x30, [sp, #-224]!\n"
+        "mov x29, sp\n"
+        "stp x0, x1, [sp, #16]\n"
+        "stp x2, x3, [sp, #32]\n"
+        "stp x4, x5, [sp, #48]\n"
+        "stp x6, x7, [sp, #64]\n"
+        "str x8, [sp, #80]\n"
+        "stp q0, q1, [sp, #96]\n"
+        "stp q2, q3, [sp, #128]\n"
+        "stp q4, q5, [sp, #160]\n"
+        "stp q6, q7, [sp, #192]\n"
+        "mov w0, w17\n"
+        "bl autocompat_resolve_slot\n"
+        "mov x16, x0\n"
+        "ldp q6, q7, [sp, #192]\n"
+        "ldp q4, q5, [sp, #160]\n"
+        "ldp q2, q3, [sp, #128]\n"
+        "ldp q0, q1, [sp, #96]\n"
+        "ldr x8, [sp, #80]\n"
+        "ldp x6, x7, [sp, #64]\n"
+        "ldp x4, x5, [sp, #48]\n"
+        "ldp x2, x3, [sp, #32]\n"
+        "ldp x0, x1, [sp, #16]\n"
+        "ldp x29, x30, [sp], #224\n"
+        "br x16\n"
+        ".size autocompat_forward_slow, .-autocompat_forward_slow\n");
+    #endif
+
+    #define AUTOCOMPAT_TRAMPOLINE(index, name)                                 \
+        __asm__(".text\n"                                                      \
+                ".p2align 4\n"                                                 \
+                ".globl autocompat_trampoline_" #name "\n"                     \
+                ".hidden autocompat_trampoline_" #name "\n"                    \
+                ".type autocompat_trampoline_" #name ", %function\n"           \
+                "autocompat_trampoline_" #name ":\n"                           \
+                AUTOCOMPAT_TRAMPOLINE_BODY(index)                              \
+                ".size autocompat_trampoline_" #name                           \
+                ", .-autocompat_trampoline_" #name "\n");                      \
+        DLL_PRIVATE void autocompat_trampoline_##name(void);
+
+    #define AUTOCOMPAT_EARLY_RESOLVE(name)                                     \
+        __atomic_store_n(&trampolines_used, true, __ATOMIC_RELAXED);           \
+        return autocompat_trampoline_##name;
+#else
+    #define AUTOCOMPAT_TRAMPOLINE(index, name)
+    #define AUTOCOMPAT_EARLY_RESOLVE(name)
+#endif
+
+// Export name as an IFUNC resolved to the driver's own entry point.  The
+// declared type is irrelevant since callers use the driver's prototypes.
+#define AUTOCOMPAT_FORWARD(index, name)                                        \
+    AUTOCOMPAT_TRAMPOLINE(index, name)                                         \
+    static driver_fn resolve_##name(void) {                                    \
+        if (resolve_early()) {                                                 \
+            AUTOCOMPAT_EARLY_RESOLVE(name)                                     \
+        }                                                                      \
+        return resolve_driver_symbol(#name);                                   \
+    }                                                                          \
+    DLL_PUBLIC void name(void) __attribute__((ifunc("resolve_" #name)));
+#include "driver_api.inc"
+#undef AUTOCOMPAT_FORWARD
+
+#if AUTOCOMPAT_HAVE_TRAMPOLINES
+
+static void (*const trampolines[AUTOCOMPAT_FORWARD_COUNT])(void) = {
+    #define AUTOCOMPAT_FORWARD(index, name) [index] = autocompat_trampoline_##name,
+    #include "driver_api.inc"
+    #undef AUTOCOMPAT_FORWARD
+};
+
+typedef struct {
+    uintptr_t addr;
+    int index;
+} trampoline_addr;
+
+// The trampolines by address for mapping a GOT entry back to its slot
+static trampoline_addr sorted_trampolines[AUTOCOMPAT_FORWARD_COUNT];
+
+static int compare_trampoline_addrs(const void *a, const void *b) {
+    uintptr_t addr_a = ((const trampoline_addr *)a)->addr;
+    uintptr_t addr_b = ((const trampoline_addr *)b)->addr;
+    return (addr_a > addr_b) - (addr_a < addr_b);
+}
+
+static void *rebind_import(const char *name, void *current, void *data) {
+    (void)name;
+    (void)data;
+    uintptr_t addr = (uintptr_t)current;
+    if (addr < sorted_trampolines[0].addr ||
+        addr > sorted_trampolines[AUTOCOMPAT_FORWARD_COUNT - 1].addr) {
+        return NULL;
+    }
+
+    int lo = 0;
+    int hi = AUTOCOMPAT_FORWARD_COUNT - 1;
+    while (lo <= hi) {
+        int mid = lo + ((hi - lo) / 2);
+        if (sorted_trampolines[mid].addr == addr) {
+            driver_fn fn = fill_slot(sorted_trampolines[mid].index);
+            void *replacement = NULL;
+            (void)memcpy(&replacement, &fn, sizeof(fn));
+            return replacement;
+        }
+        if (sorted_trampolines[mid].addr < addr) {
+            lo = mid + 1;
         } else {
-            LOG_ERROR("Search error");
+            hi = mid - 1;
         }
-        exit(EXIT_FAILURE);
     }
+    return NULL;
+}
+
+// Once the driver is loaded, bind every call that went to a trampoline, i.e.
+// resolved during startup relocation or before a lazy load, straight to the
+// driver so only the first call through each one pays for the indirection
+static void rebind_trampolines(void) {
+    if (!libcuda_handle ||
+        !__atomic_load_n(&trampolines_used, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    for (int i = 0; i < AUTOCOMPAT_FORWARD_COUNT; ++i) {
+        (void)memcpy(&sorted_trampolines[i].addr, &trampolines[i],
+                     sizeof(sorted_trampolines[i].addr));
+        sorted_trampolines[i].index = i;
+    }
+    qsort(sorted_trampolines, AUTOCOMPAT_FORWARD_COUNT,
+          sizeof(sorted_trampolines[0]), compare_trampoline_addrs);
 
-    if (load_driver_libs() != 0) {
-        LOG_ERROR("Error loading driver libs");
-        if (unload_driver_libs() != 0) {
-            LOG_ERROR("Error unloading driver libs");
+    void *main_handle = dlopen(NULL, RTLD_LAZY);
+    struct link_map *map = NULL;
+    if (!main_handle || dlinfo(main_handle, RTLD_DI_LINKMAP, &map) != 0) {
+        map = NULL;
+    }
+    for (; map; map = map->l_next) {
+        (void)rewrite_dynamic_imports(map, rebind_import, NULL);
+    }
+    if (main_handle) {
+        (void)dlclose(main_handle);
+    }
+}
+
+#endif
+
+DLL_PUBLIC int cuGetProcAddress(const char *symbol, void **pfn,
+                                int cuda_version, uint64_t flags);
+DLL_PUBLIC int cuGetProcAddress_v2(const char *symbol, void **pfn,
+                                   int cuda_version, uint64_t flags,
+                                   int *symbol_status);
+
+// Forward a cuGetProcAddress lookup to the driver unless it's already been
+// memoized.  Either variant can hand out the driver's own cuGetProcAddress
+// entry points, which would bypass the memo from then on, so those are
+// replaced with the shim's.
+static int get_proc_address(proc_address_api api, const char *symbol,
+                            void **pfn, int cuda_version, uint64_t flags,
+                            int *symbol_status) {
+    if (!symbol || !pfn) {
+        return CUDA_ERROR_INVALID_VALUE;
+    }
+
+    proc_address_key key = {symbol, cuda_version, flags, api};
+    proc_address_value value;
+    if (!proc_address_cache_find(&key, &value)) {
+        (void)pthread_once(&load_once, load_driver_libs);
+
+        value.pfn = NULL;
+        value.symbol_status = 0;
+        if (api == PROC_ADDRESS_V2 && driver_get_proc_address_v2) {
+            value.result = driver_get_proc_address_v2(
+                symbol, &value.pfn, cuda_version, flags, &value.symbol_status);
+        } else if (api == PROC_ADDRESS_V1 && driver_get_proc_address) {
+            value.result = driver_get_proc_address(symbol, &value.pfn,
+                                                   cuda_version, flags);
+        } else {
+            value.result =
+                libcuda_handle ? CUDA_ERROR_NOT_FOUND : CUDA_ERROR_NO_DEVICE;
         }
+
+        get_proc_address_fn own = cuGetProcAddress;
+        get_proc_address_v2_fn own_v2 = cuGetProcAddress_v2;
+        if (value.pfn && memcmp(&value.pfn, &driver_get_proc_address,
+                                sizeof(value.pfn)) == 0) {
+            (void)memcpy(&value.pfn, &own, sizeof(value.pfn));
+        } else if (value.pfn && memcmp(&value.pfn, &driver_get_proc_address_v2,
+                                       sizeof(value.pfn)) == 0) {
+            (void)memcpy(&value.pfn, &own_v2, sizeof(value.pfn));
+        }
+
+        // Anything else, i.e. an invalid argument, isn't a property of the
+        // symbol so is left for the driver to report every time
+        if (value.result == CUDA_SUCCESS ||
+            value.result == CUDA_ERROR_NOT_FOUND) {
+            proc_address_cache_insert(&key, &value);
+        }
+    }
+
+    *pfn = value.pfn;
+    if (symbol_status) {
+        *symbol_status = value.symbol_status;
+    }
+    return value.result;
+}
+
+DLL_PUBLIC int cuGetProcAddress(const char *symbol, void **pfn,
+                                int cuda_version, uint64_t flags) {
+    return get_proc_address(PROC_ADDRESS_V1, symbol, pfn, cuda_version,
+                            flags, NULL);
+}
+
+DLL_PUBLIC int cuGetProcAddress_v2(const char *symbol, void **pfn,
+                                   int cuda_version, uint64_t flags,
+                                   int *symbol_status) {
+    return get_proc_address(PROC_ADDRESS_V2, symbol, pfn, cuda_version,
+                            flags, symbol_status);
+}
+
+// Whether the calling thread is the only one in the process, from the
+// num_threads field of /proc/self/stat.  Unlike the audit library the shim
+// has no hook that runs before main, and is often loaded by a dlopen in
+// libcudart on one of the application's threads, so this is the only way to
+// tell that setting the environment can't race with another thread reading
+// it.  When it can't be read the process is assumed to be multithreaded.
+static bool is_single_threaded(void) {
+    int fd = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char stat[1024];
+    ssize_t len = read(fd, stat, sizeof(stat) - 1);
+    (void)close(fd);
+    if (len <= 0) {
+        return false;
+    }
+    stat[len] = '\0';
+
+    // The command name may contain spaces, so count fields from the ')'
+    // closing it; num_threads is the 18th after it
+    const char *field = strrchr(stat, ')');
+    for (int i = 0; field && i < 18; ++i) {
+        field = strchr(field + 1, ' ');
+    }
+    return field && strtol(field + 1, NULL, 10) == 1;
+}
+
+DLL_CONSTRUCTOR
+void libcuda_ctor(void) {
+    // Lazy mode relies on the trampolines to trigger the load
+    const char *lazy = secure_getenv(AUTOCOMPAT_LAZY_ENV);
+    lazy_mode = AUTOCOMPAT_HAVE_TRAMPOLINES && lazy && lazy[0] != '\0' &&
+                strcmp(lazy, "0") != 0;
+    __atomic_store_n(&resolvers_ready, true, __ATOMIC_RELEASE);
+
+    // Exporting the resolved driver for child processes is skipped as well
+    // since setenv isn't safe once other threads may be running
+    if (lazy_mode || secure_getenv(AUTOCOMPAT_HELPER_ENV)) {
+        return;
+    }
+    (void)pthread_once(&load_once, load_driver_libs);
+#if AUTOCOMPAT_HAVE_TRAMPOLINES
+    (void)pthread_once(&rebind_once, rebind_trampolines);
+#endif
+    if (!loaded_result) {
+        fputs("error: No usable libcuda.so.1 found\n", stderr);
         exit(EXIT_FAILURE);
     }
+
+    // Let descendants reuse the result rather than searching again; see
+    // resolved_token.h.  This is only done while the application is still
+    // single threaded, i.e. the shim was loaded during startup or by a
+    // dlopen before any threads were created, since setenv could otherwise
+    // race with another thread reading the environment.  Descendants of
+    // any other process search for the driver themselves.
+    if (!is_single_threaded()) {
+        return;
+    }
+    char token[AUTOCOMPAT_RESOLVED_MAX];
+    if (results.inputs != 0 &&
+        format_resolved_token(loaded_result, results.inputs, token,
+                              sizeof(token)) &&
+        setenv(AUTOCOMPAT_RESOLVED_ENV, token, 1) != 0) {
+        fprintf(stderr, "warning: Failed to export %s\n",
+                AUTOCOMPAT_RESOLVED_ENV);
+    }
+
+    // Descendants whose search inputs differ still need the helper
+    char helper_fd[16];
+    if (embedded_helper_fd() >= 0) {
+        (void)snprintf(helper_fd, sizeof(helper_fd), "%d",
+                       embedded_helper_fd());
+        (void)setenv(AUTOCOMPAT_HELPER_FD_ENV, helper_fd, 1);
+    }
 }
 
 DLL_DESTRUCTOR
 void libcuda_dtor(void) {
-    if (unload_driver_libs() != 0) {
-        LOG_ERROR("Error unloading driver libs");
-    }
-    autocompat_destroy();
+    unload_driver_libs();
 }
@@ -0,0 +1,128 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "proc_address_cache.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fingerprint.h"
+
+// Comfortably more than the number of distinct lookups a CUDA 12 runtime and
+// a framework make, which is a few per driver API entry point
+#define CACHE_SLOTS 8192
+#define CACHE_MAX_PROBES 32
+#define CACHE_NAMES_SIZE (256 * 1024)
+
+enum {
+    SLOT_EMPTY = 0,
+    SLOT_BUSY = 1,
+    SLOT_READY = 2,
+};
+
+typedef struct {
+    uint32_t state;
+    int cuda_version;
+    uint64_t hash;
+    uint64_t flags;
+    const char *symbol;
+    proc_address_api api;
+    proc_address_value value;
+} cache_slot;
+
+static cache_slot slots[CACHE_SLOTS];
+
+// Symbol names are copied into a bump allocated arena since callers' strings
+// may not outlive the call
+static char names[CACHE_NAMES_SIZE];
+static size_t names_used = 0;
+
+static uint64_t hash_key(const proc_address_key *key, size_t symbol_len) {
+    uint64_t hash = autocompat_fnv1a(AUTOCOMPAT_FNV1A_INIT, key->symbol,
+                                     symbol_len);
+    const uint64_t fields[] = {(uint64_t)key->cuda_version, key->flags,
+                               (uint64_t)key->api};
+    return autocompat_fnv1a(hash, fields, sizeof(fields));
+}
+
+static bool slot_matches(const cache_slot *slot, uint64_t hash,
+                         const proc_address_key *key) {
+    return slot->hash == hash && slot->cuda_version == key->cuda_version &&
+           slot->flags == key->flags && slot->api == key->api &&
+           strcmp(slot->symbol, key->symbol) == 0;
+}
+
+bool proc_address_cache_find(const proc_address_key *key,
+                             proc_address_value *value) {
+    uint64_t hash = hash_key(key, strlen(key->symbol));
+    for (uint64_t i = 0; i < CACHE_MAX_PROBES; ++i) {
+        const cache_slot *slot = &slots[(hash + i) & (CACHE_SLOTS - 1)];
+        uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_EMPTY) {
+            return false;
+        }
+        if (state == SLOT_READY && slot_matches(slot, hash, key)) {
+            *value = slot->value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *copy_name(const char *symbol, size_t len) {
+    size_t offset =
+        __atomic_fetch_add(&names_used, len + 1, __ATOMIC_RELAXED);
+    if (offset + len + 1 > sizeof(names)) {
+        return NULL;
+    }
+    (void)memcpy(names + offset, symbol, len + 1);
+    return names + offset;
+}
+
+void proc_address_cache_insert(const proc_address_key *key,
+                               const proc_address_value *value) {
+    size_t len = strlen(key->symbol);
+    uint64_t hash = hash_key(key, len);
+    for (uint64_t i = 0; i < CACHE_MAX_PROBES; ++i) {
+        cache_slot *slot = &slots[(hash + i) & (CACHE_SLOTS - 1)];
+        uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_READY && slot_matches(slot, hash, key)) {
+            return; // Another thread got here first
+        }
+        if (state != SLOT_EMPTY ||
+            !__atomic_compare_exchange_n(&slot->state, &state, SLOT_BUSY,
+                                         false, __ATOMIC_ACQUIRE,
+                                         __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        const char *symbol = copy_name(key->symbol, len);
+        if (!symbol) {
+            // Out of space for names so the table is effectively full
+            __atomic_store_n(&slot->state, SLOT_EMPTY, __ATOMIC_RELEASE);
+            return;
+        }
+        slot->hash = hash;
+        slot->cuda_version = key->cuda_version;
+        slot->flags = key->flags;
+        slot->api = key->api;
+        slot->symbol = symbol;
+        slot->value = *value;
+        __atomic_store_n(&slot->state, SLOT_READY, __ATOMIC_RELEASE);
+        return;
+    }
+}
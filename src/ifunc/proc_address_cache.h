@@ -0,0 +1,65 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_IFUNC_PROC_ADDRESS_CACHE_H
+#define CUDA_AUTOCOMPAT_IFUNC_PROC_ADDRESS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A process-wide memo of the driver's cuGetProcAddress results.  The runtime
+// and frameworks built on it look up the same few hundred entry points over
+// and over, for every library and every context, while the answer for a
+// given symbol, CUDA version, and set of flags never changes once a driver
+// is loaded.
+//
+// Lookups are lock-free and only read shared memory, so concurrent callers
+// never contend once the table is warm.  Inserts claim an empty slot with a
+// compare-and-swap and publish it with a release store; a slot that's being
+// filled is simply skipped, so the worst a race can cost is an extra call
+// into the driver.  The table is fixed-size and never evicts; when it's full
+// further results just aren't memoized.
+
+// The cuGetProcAddress variant a result came from since their lookups aren't
+// guaranteed to agree
+typedef enum {
+    PROC_ADDRESS_V1 = 0,
+    PROC_ADDRESS_V2 = 1,
+} proc_address_api;
+
+typedef struct {
+    const char *symbol;
+    int cuda_version;
+    uint64_t flags;
+    proc_address_api api;
+} proc_address_key;
+
+typedef struct {
+    int result;
+    void *pfn;
+    int symbol_status;
+} proc_address_value;
+
+// Look up a previously memoized result for key
+//
+// return:
+//   true and sets value if found; false otherwise
+bool proc_address_cache_find(const proc_address_key *key,
+                             proc_address_value *value);
+
+// Memoize value as the result for key, copying the symbol name
+void proc_address_cache_insert(const proc_address_key *key,
+                               const proc_address_value *value);
+
+#endif // CUDA_AUTOCOMPAT_IFUNC_PROC_ADDRESS_CACHE_H
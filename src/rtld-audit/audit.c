@@ -18,25 +18,94 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "driver_libs.h"
+#include "dynamic_symbol.h"
+#include "fingerprint.h"
+#include "huge_text.h"
+#include "metrics.h"
 #include "path_utils.h"
+#include "resolved_token.h"
 #include "search_helper.h"
+#include "search_order.h"
 #include "visibility.h"
 #include "version.h"
 
-#define LIBCUDA_SONAME "libcuda.so.1"
-#define LIBNVIDIA_NVVM_SONAME "libnvidia-nvvm.so.4"
-#define LIBNVIDIA_PTXJITCOMPILER_SONAME "libnvidia-ptxjitcompiler.so.1"
-#define LIBCUDADEBUGGER_SONAME "libcudadebugger.so.1"
+static search_results results;
 
-static char libcuda_path[PATH_MAX];
-static char libnvidia_nvvm_path[PATH_MAX];
-static char libnvidia_ptxjitcompiler_path[PATH_MAX];
-static char libcudadebugger_path[PATH_MAX];
-static int libcuda_path_len;
-static int libnvidia_nvvm_path_len;
-static int libnvidia_ptxjitcompiler_path_len;
-static int libcudadebugger_path_len;
+// The result currently redirected to, selected the first time a driver
+// library is looked up; NULL if none is usable
+static const search_result *active_result;
+static bool active_result_selected;
+
+// Whether to back the driver's text with huge pages; see huge_text.h
+static bool huge_text;
+
+// Check that a result's libcuda.so.1 is the same file the helper probed
+static bool result_is_current(const search_result *result) {
+    struct stat libcuda_stat;
+    if (stat(result->paths[DRIVER_LIB_LIBCUDA], &libcuda_stat) != 0) {
+        return false;
+    }
+    return autocompat_fingerprint(
+               libcuda_stat.st_dev, libcuda_stat.st_ino, libcuda_stat.st_size,
+               libcuda_stat.st_mtim.tv_sec, libcuda_stat.st_mtim.tv_nsec) ==
+           result->fingerprint;
+}
+
+// The application's C library, which the resolved token has to be exported
+// through for the application's descendants to inherit it since the audit
+// library has its own
+static struct link_map *base_libc;
+
+static void *base_libc_sym(const char *name) {
+    return lookup_dynamic_symbol(base_libc, name);
+}
+
+// Export the active result for descendants; see resolved_token.h
+static void export_resolved_token(void) {
+    if (!base_libc || !active_result || results.inputs == 0) {
+        return;
+    }
+
+    // The application's C library only sets up its environment once it's
+    // initialized, so without one there's nothing to add to
+    char ***base_environ = base_libc_sym("environ");
+    if (!base_environ || !*base_environ) {
+        return;
+    }
+
+    char *(*base_getenv)(const char *) = NULL;
+    int (*base_setenv)(const char *, const char *, int) = NULL;
+    void *sym = base_libc_sym("getenv");
+    (void)memcpy(&base_getenv, &sym, sizeof(sym));
+    sym = base_libc_sym("setenv");
+    (void)memcpy(&base_setenv, &sym, sizeof(sym));
+    if (!base_getenv || !base_setenv) {
+        return;
+    }
+
+    char token[AUTOCOMPAT_RESOLVED_MAX];
+    if (!format_resolved_token(active_result, results.inputs, token,
+                               sizeof(token))) {
+        return;
+    }
+    const char *inherited = base_getenv(AUTOCOMPAT_RESOLVED_ENV);
+    if (!inherited || strcmp(inherited, token) != 0) {
+        (void)base_setenv(AUTOCOMPAT_RESOLVED_ENV, token, 1);
+    }
+
+    // Descendants whose search inputs differ still need the helper
+    char helper_fd[16];
+    if (embedded_helper_fd() >= 0) {
+        (void)snprintf(helper_fd, sizeof(helper_fd), "%d",
+                       embedded_helper_fd());
+        (void)base_setenv(AUTOCOMPAT_HELPER_FD_ENV, helper_fd, 1);
+    }
+}
 
 typedef struct {
     char data[PATH_MAX];
@@ -108,7 +177,7 @@ void sanitize_ld_audit(ld_audit_backup *backup) {
             backup->trailing_len = trailing_len;
             (void)memmove(backup->slot, cursor, trailing_len);
             (void)memset(backup->slot + trailing_len, '\0', slot_len);
-            break;
+            return;
         }
     }
 
@@ -138,64 +207,137 @@ void restore_ld_audit(ld_audit_backup *backup) {
     (void)memset(backup, 0, sizeof(ld_audit_backup));
 }
 
-DLL_PUBLIC
-unsigned int la_version(unsigned int version) {
-    memset(libcuda_path, 0, PATH_MAX);
-    memset(libnvidia_nvvm_path, 0, PATH_MAX);
-    memset(libnvidia_ptxjitcompiler_path, 0, PATH_MAX);
-    memset(libcudadebugger_path, 0, PATH_MAX);
-    libcuda_path_len = -1;
-    libnvidia_nvvm_path_len = -1;
-    libnvidia_ptxjitcompiler_path_len = -1;
-    libcudadebugger_path_len = -1;
+// The search started at la_version for applications that are known to need
+// the driver; see la_version
+static search_job early_job;
+static bool early_job_started;
 
+// Start the search, with this library removed from LD_AUDIT so the helper
+// isn't audited itself.  Only spawning the helper needs the sanitized
+// environment so it's restored before the results are waited for.
+static bool start_driver_search(search_job *job) {
     static ld_audit_backup backup;
 
     memset(&backup, 0, sizeof(backup));
     sanitize_ld_audit(&backup);
 
-    static char libcuda_dir[PATH_MAX];
-    size_t libcuda_dir_len = find_libcuda(libcuda_dir);
-    if (libcuda_dir_len == 0) {
-        fputs("error: Failed to locate a usable libcuda.so.1\n", stderr);
-    } else {
-        libcuda_path_len = path_join2(libcuda_path, libcuda_dir,
-                                      libcuda_dir_len, LIBCUDA_SONAME);
-        libnvidia_nvvm_path_len =
-            path_join2(libnvidia_nvvm_path, libcuda_dir, libcuda_dir_len,
-                       LIBNVIDIA_NVVM_SONAME);
-        libnvidia_ptxjitcompiler_path_len =
-            path_join2(libnvidia_ptxjitcompiler_path, libcuda_dir,
-                       libcuda_dir_len, LIBNVIDIA_PTXJITCOMPILER_SONAME);
-        libcudadebugger_path_len =
-            path_join2(libcudadebugger_path, libcuda_dir, libcuda_dir_len,
-                       LIBCUDADEBUGGER_SONAME);
-    }
+    bool started = start_search(job, &results);
 
     if (backup.slot) {
         restore_ld_audit(&backup);
     }
+    return started;
+}
+
+static void search_driver(void) {
+    const uint64_t start_us = autocompat_metrics_now_us();
+    search_job job;
+    int count = 0;
+    if (early_job_started) {
+        early_job_started = false;
+        count = finish_search(&early_job, &results);
+    } else if (start_driver_search(&job)) {
+        count = finish_search(&job, &results);
+    }
+
+    // The application closed the early search's output, so start over
+    if (count < 0 && start_driver_search(&job)) {
+        count = finish_search(&job, &results);
+    }
+    if (count <= 0) {
+        fputs("error: Failed to locate a usable libcuda.so.1\n", stderr);
+    }
+    autocompat_metrics_record_resolution(
+        AUTOCOMPAT_METRICS_AUDIT,
+        count > 0 ? results.outcome : AUTOCOMPAT_METRICS_FAILED,
+        count > 0 ? results.entries[0].version : 0,
+        autocompat_metrics_now_us() - start_us);
+}
+
+// Drop the optional libraries the result's directory doesn't have so
+// requests for them are left to the normal search
+static void check_optional_libs(search_result *result) {
+    for (int lib = DRIVER_LIB_REQUIRED_COUNT; lib < DRIVER_LIB_COUNT; ++lib) {
+        if (access(result->paths[lib], F_OK) != 0) {
+            result->path_lens[lib] = 0;
+        }
+    }
+}
+
+// Select the best result whose driver hasn't been removed or replaced since
+// the search, falling back to the next ranked one otherwise
+static const search_result *get_active_result(void) {
+    if (active_result_selected) {
+        return active_result;
+    }
+    active_result_selected = true;
+    search_driver();
+
+    for (int i = 0; i < results.count; ++i) {
+        search_result *result = &results.entries[i];
+        if (result_is_current(result)) {
+            check_optional_libs(result);
+            active_result = result;
+            break;
+        }
+        fprintf(stderr, "warning: %s changed since search; skipping\n",
+                result->paths[DRIVER_LIB_LIBCUDA]);
+    }
+    if (!active_result && results.count > 0) {
+        fputs("error: No usable libcuda.so.1 remaining\n", stderr);
+    }
+    return active_result;
+}
+
+// The search is deferred until a driver library is first requested so
+// processes that never use CUDA, i.e. shells and coreutils when LD_AUDIT is
+// set globally, don't pay for it.  When the main executable links against
+// libcudart or libcuda directly the driver is all but certain to be needed,
+// so the helper is started right away and runs while the application's
+// libraries are loaded and initialized, only being waited for once the
+// driver is requested.
+DLL_PUBLIC
+unsigned int la_version(unsigned int version) {
+    (void)memset(&results, 0, sizeof(results));
+    active_result = NULL;
+    active_result_selected = false;
+    base_libc = NULL;
+    huge_text = huge_text_requested();
+
+    early_job_started = main_exe_needs_driver() &&
+                        start_driver_search(&early_job);
 
     return LAV_CURRENT;
 }
 
 DLL_PUBLIC
 char *la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag) {
-    // All lib paths will be set or none of them will be set so I only need to
-    // check libcuda_path to know if initialization was successful
-    if (libcuda_path[0] != '\0') {
-        if (strcmp2(name, LIBCUDA_SONAME) == 0) {
-            return libcuda_path;
-        } else if (strcmp2(name, LIBNVIDIA_NVVM_SONAME) == 0) {
-            return libnvidia_nvvm_path;
-        } else if (strcmp2(name, LIBNVIDIA_PTXJITCOMPILER_SONAME) == 0) {
-            return libnvidia_ptxjitcompiler_path;
-        } else if (strcmp2(name, LIBCUDADEBUGGER_SONAME) == 0) {
-            return libcudadebugger_path;
-        }
+    // Only the name as requested can be a bare soname; the calls that follow
+    // for each directory searched are for paths built from it
+    if (flag != LA_SER_ORIG) {
+        return (char *)name;
     }
 
-    return (char *)name;
+    int lib = find_driver_lib(name);
+    if (lib < 0) {
+        return (char *)name;
+    }
+    const search_result *result = get_active_result();
+    if (!result || result->path_lens[lib] == 0) {
+        return (char *)name;
+    }
+    return (char *)result->paths[lib];
+}
+
+// The token is only exported here, once the application's C library is
+// initialized but before main, while the application is still single
+// threaded.  A driver first requested by a later dlopen, possibly on one of
+// the application's threads, isn't exported since setting the environment
+// there could race with the application reading it.
+DLL_PUBLIC
+void la_preinit(uintptr_t *cookie) {
+    (void)cookie;
+    export_resolved_token();
 }
 
 DLL_PUBLIC
@@ -206,12 +348,28 @@ unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie) {
     if (!name || name[0] == '\0') {
         return 0;
     }
+    if (lmid == LM_ID_BASE && !base_libc &&
+        strcmp(path_filename2(name, NULL), "libc.so.6") == 0) {
+        base_libc = map;
+    }
+    if (!active_result) {
+        return 0;
+    }
 
-    if (strncmp(name, libcuda_path, libcuda_path_len) == 0 ||
-        strncmp(name, libnvidia_nvvm_path, libnvidia_nvvm_path_len) == 0 ||
-        strncmp(name, libnvidia_ptxjitcompiler_path,
-                libnvidia_ptxjitcompiler_path_len) == 0 ||
-        strncmp(name, libcudadebugger_path, libcudadebugger_path_len) == 0) {
+    // Every path in the result shares the driver directory and its trailing
+    // slash
+    const char *dir = active_result->paths[DRIVER_LIB_LIBCUDA];
+    int dir_len = active_result->dir_len + 1;
+    if (strncmp(name, dir, dir_len) == 0) {
+        int lib = find_driver_lib(name + dir_len);
+        if (lib < 0) {
+            return 0;
+        }
+        // The driver is mapped but none of its code, not even its
+        // constructors, has run yet
+        if (lib == DRIVER_LIB_LIBCUDA && huge_text) {
+            (void)remap_text_huge(map);
+        }
         return LA_FLG_BINDTO | LA_FLG_BINDFROM;
     }
 
@@ -0,0 +1,118 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deadline.h"
+
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include "logging.h"
+
+namespace autocompat {
+
+// State shared between the search and the worker thread.  The worker holds
+// its own reference so an abandoned worker never touches freed memory.
+struct Deadline::Worker {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::function<void(void)> task;
+    bool task_done = true;
+};
+
+void Deadline::set_budget(std::chrono::milliseconds budget) {
+    if (budget.count() <= 0) {
+        this->end.reset();
+        return;
+    }
+    this->end = this->start + budget;
+    log_info("Search deadline: {} ms", budget.count());
+}
+
+bool Deadline::enabled(void) const { return this->end.has_value(); }
+
+bool Deadline::expired(void) {
+    if (!this->is_expired && this->end && clock::now() >= *this->end) {
+        log_warn("Search deadline expired; using the best result so far");
+        this->is_expired = true;
+    }
+    return this->is_expired;
+}
+
+const std::vector<std::filesystem::path> &
+Deadline::get_abandoned(void) const {
+    return this->abandoned;
+}
+
+const std::vector<std::filesystem::path> &Deadline::get_skipped(void) const {
+    return this->skipped;
+}
+
+bool Deadline::run_task(const std::filesystem::path &subject,
+                        std::function<void(void)> task) {
+    if (this->expired()) {
+        log_verbose("Skipping {} (deadline expired)", subject);
+        this->skipped.push_back(subject);
+        return false;
+    }
+
+    // Once started the worker runs one task at a time for the rest of the
+    // search; at most one worker is ever needed since abandoning a task also
+    // expires the deadline
+    if (!this->worker) {
+        this->worker = std::make_shared<Worker>();
+        std::thread([worker = this->worker]() {
+            std::unique_lock lock(worker->mutex);
+            for (;;) {
+                worker->cond.wait(lock, [&] { return !worker->task_done; });
+                auto current_task = std::move(worker->task);
+                lock.unlock();
+                current_task();
+                lock.lock();
+                worker->task_done = true;
+                worker->cond.notify_all();
+            }
+        }).detach();
+    }
+
+    std::unique_lock lock(this->worker->mutex);
+    this->worker->task = std::move(task);
+    this->worker->task_done = false;
+    this->worker->cond.notify_all();
+    if (!this->worker->cond.wait_until(lock, *this->end,
+                                       [&] { return this->worker->task_done; })) {
+        log_warn("Abandoning {} (deadline expired)", subject);
+        this->abandoned.push_back(subject);
+        this->is_expired = true;
+        return false;
+    }
+    return true;
+}
+
+bool parse_deadline_ms(const std::string_view src,
+                       std::chrono::milliseconds &out) {
+    int value = 0;
+    const char *const end = src.data() + src.size();
+    const auto [ptr, ec] = std::from_chars(src.data(), end, value);
+    if (ec != std::errc{} || ptr != end || value < 0) {
+        return false;
+    }
+    out = std::chrono::milliseconds{value};
+    return true;
+}
+
+} // namespace autocompat
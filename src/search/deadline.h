@@ -0,0 +1,112 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_DEADLINE_H
+#define CUDA_AUTOCOMPAT_SEARCH_DEADLINE_H
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace autocompat {
+
+// A time budget for the whole search.  Filesystem and probe work is run on a
+// worker thread so an operation that hangs, i.e. a stat on a stale NFS mount,
+// can be abandoned when the budget runs out rather than blocking the search
+// and the process waiting on it.  Once expired every remaining operation is
+// skipped so the search finishes with the best result validated so far.
+class Deadline {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    Deadline(const Deadline &) = delete;
+    Deadline &operator=(Deadline &) = delete;
+    Deadline(Deadline &&) = delete;
+    Deadline &operator=(Deadline &&) = delete;
+
+    Deadline(void) = default;
+    ~Deadline(void) = default;
+
+    // Limit the search to budget measured from when the process started; a
+    // budget of zero disables the deadline
+    void set_budget(std::chrono::milliseconds budget);
+
+    bool enabled(void) const;
+
+    bool expired(void);
+
+    // Run fn, on the worker thread if the deadline is enabled, and return its
+    // result; std::nullopt if the deadline expired first.  subject is the
+    // path fn operates on, recorded if it's skipped or abandoned.  Since fn
+    // may be abandoned and outlive the caller it must capture by value.
+    template <typename Fn>
+    std::optional<std::invoke_result_t<Fn &>>
+    run(const std::filesystem::path &subject, Fn fn);
+
+    // Paths whose operations were abandoned because they were still running
+    // when the deadline expired
+    const std::vector<std::filesystem::path> &get_abandoned(void) const;
+
+    // Paths whose operations were never started because the deadline had
+    // already expired
+    const std::vector<std::filesystem::path> &get_skipped(void) const;
+
+  private:
+    struct Worker;
+
+    bool run_task(const std::filesystem::path &subject,
+                  std::function<void(void)> task);
+
+    clock::time_point start = clock::now();
+    std::optional<clock::time_point> end;
+    bool is_expired = false;
+    std::shared_ptr<Worker> worker;
+    std::vector<std::filesystem::path> abandoned;
+    std::vector<std::filesystem::path> skipped;
+};
+
+template <typename Fn>
+std::optional<std::invoke_result_t<Fn &>>
+Deadline::run(const std::filesystem::path &subject, Fn fn) {
+    using result_type = std::invoke_result_t<Fn &>;
+
+    if (!this->enabled()) {
+        return fn();
+    }
+
+    // Shared with the task so it remains valid if the task is abandoned
+    auto result = std::make_shared<std::optional<result_type>>();
+    if (!this->run_task(subject, [result, fn = std::move(fn)]() mutable {
+            result->emplace(fn());
+        })) {
+        return std::nullopt;
+    }
+    return std::move(*result);
+}
+
+inline Deadline SEARCH_DEADLINE;
+
+// Parse a non-negative number of milliseconds
+bool parse_deadline_ms(std::string_view src, std::chrono::milliseconds &out);
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_DEADLINE_H
@@ -0,0 +1,127 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_DRIVER_VERSIONS_H
+#define CUDA_AUTOCOMPAT_SEARCH_DRIVER_VERSIONS_H
+
+#include <array>
+#include <optional>
+
+namespace autocompat {
+
+struct DriverBranch {
+    int branch;
+    int cuda_version;
+};
+
+// The CUDA version supported by each Linux driver branch, in the
+// cuDriverGetVersion encoding
+constexpr auto DRIVER_BRANCHES = std::to_array<DriverBranch>({
+    {450, 11000},
+    {455, 11010},
+    {460, 11020},
+    {465, 11030},
+    {470, 11040},
+    {495, 11050},
+    {510, 11060},
+    {515, 11070},
+    {520, 11080},
+    {525, 12000},
+    {530, 12010},
+    {535, 12020},
+    {545, 12030},
+    {550, 12040},
+    {555, 12050},
+    {560, 12060},
+    {565, 12070},
+    {570, 12080},
+    {575, 12090},
+    {580, 13000},
+});
+
+// Upper bound on the CUDA version a driver from the given branch can report.
+// Branches newer than the table may support anything so have no bound.
+constexpr std::optional<int> driver_branch_version_bound(int branch) {
+    if (branch < DRIVER_BRANCHES.front().branch ||
+        branch > DRIVER_BRANCHES.back().branch) {
+        return std::nullopt;
+    }
+
+    int bound = DRIVER_BRANCHES.front().cuda_version;
+    for (const auto &entry : DRIVER_BRANCHES) {
+        if (entry.branch > branch) {
+            break;
+        }
+        bound = entry.cuda_version;
+    }
+    return bound;
+}
+
+static_assert(driver_branch_version_bound(550) == 12040);
+static_assert(driver_branch_version_bound(551) == 12040);
+static_assert(!driver_branch_version_bound(1));
+static_assert(!driver_branch_version_bound(999));
+
+// A Linux driver version, i.e. {550, 54, 15}
+using DriverVersion = std::array<int, 3>;
+
+struct ForwardCompatRule {
+    int first_branch;
+    int last_branch;
+    int min_kernel_branch;
+};
+
+// The oldest kernel module branch the forward compatibility libcuda.so.1 from
+// each range of driver branches runs on.  Only the minimum is checked, not
+// whether the kernel module is from one of the long term support branches
+// NVIDIA actually tests, so this errs on the side of probing.
+constexpr auto FORWARD_COMPAT_RULES = std::to_array<ForwardCompatRule>({
+    {450, 520, 418},
+    {525, 575, 470},
+    {580, 580, 535},
+});
+
+// Whether a user-space driver can run on the loaded kernel module.  Older
+// user-space drivers are rejected by the kernel module outright, while newer
+// ones only run on it as forward compatibility libraries from a branch whose
+// rule allows it.  Branches missing from the table are assumed to work.
+constexpr bool driver_runs_on_kernel_module(const DriverVersion &driver,
+                                            const DriverVersion &kernel) {
+    if (driver < kernel) {
+        return false;
+    }
+    if (driver[0] == kernel[0]) {
+        return true;
+    }
+    for (const auto &rule : FORWARD_COMPAT_RULES) {
+        if (driver[0] >= rule.first_branch && driver[0] <= rule.last_branch) {
+            return kernel[0] >= rule.min_kernel_branch;
+        }
+    }
+    return true;
+}
+
+static_assert(driver_runs_on_kernel_module({550, 54, 15}, {550, 54, 15}));
+static_assert(!driver_runs_on_kernel_module({535, 161, 8}, {550, 54, 15}));
+static_assert(!driver_runs_on_kernel_module({550, 54, 14}, {550, 54, 15}));
+static_assert(driver_runs_on_kernel_module({550, 54, 15}, {470, 256, 2}));
+static_assert(!driver_runs_on_kernel_module({550, 54, 15}, {460, 106, 0}));
+static_assert(driver_runs_on_kernel_module({470, 57, 2}, {418, 40, 4}));
+static_assert(!driver_runs_on_kernel_module({580, 65, 6}, {470, 256, 2}));
+static_assert(driver_runs_on_kernel_module({999, 0, 0}, {550, 54, 15}));
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_DRIVER_VERSIONS_H
@@ -0,0 +1,220 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "history.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "logging.h"
+#include "node_state.h"
+
+namespace autocompat {
+
+namespace {
+
+constexpr auto HISTORY_FILENAME = "history";
+constexpr auto HISTORY_FORMAT = "cuda-autocompat-history 1";
+
+// Enough for every driver and toolkit on any reasonable node
+constexpr size_t HISTORY_MAX_RECORDS = 256;
+
+// Weight of the newest sample in the probe time moving average, in eighths
+constexpr int64_t PROBE_TIME_WEIGHT = 2;
+
+// Parse a single "<fingerprint> <version> <probe us> <wins> <losses>
+// <last probed> <path>" line
+bool parse_record(const std::string_view line, std::filesystem::path &path,
+                  ProbeRecord &record) {
+    const char *cursor = line.data();
+    const char *const end = line.data() + line.size();
+
+    const auto parse_field = [&](auto &value, int base = 10) {
+        const auto [ptr, ec] = std::from_chars(cursor, end, value, base);
+        if (ec != std::errc{} || ptr == end || *ptr != ' ') {
+            return false;
+        }
+        cursor = ptr + 1;
+        return true;
+    };
+
+    int64_t probe_us = 0;
+    if (!parse_field(record.fingerprint, 16) || !parse_field(record.version) ||
+        !parse_field(probe_us) || !parse_field(record.wins) ||
+        !parse_field(record.losses) || !parse_field(record.last_probed) ||
+        cursor == end) {
+        return false;
+    }
+    record.probe_time = std::chrono::microseconds{probe_us};
+    path = std::string_view(cursor, end);
+    return true;
+}
+
+int64_t unix_time_now(void) {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+} // end anonymous namespace
+
+void ProbeHistory::load(void) {
+    const auto state_dir = get_node_state_dir(false);
+    if (!state_dir) {
+        return;
+    }
+
+    std::ifstream file(*state_dir / HISTORY_FILENAME);
+    std::string line;
+    if (!std::getline(file, line)) {
+        return;
+    }
+    if (line != HISTORY_FORMAT) {
+        log_debug("history: unrecognized format; ignoring");
+        return;
+    }
+
+    while (std::getline(file, line)) {
+        std::filesystem::path path;
+        ProbeRecord record;
+        if (!parse_record(line, path, record)) {
+            log_debug("history: skipping invalid record");
+            continue;
+        }
+        log_debug("history: {} (version = {}, {} us, {} won, {} lost)", path,
+                  record.version, record.probe_time.count(), record.wins,
+                  record.losses);
+        this->records.insert_or_assign(std::move(path), record);
+    }
+}
+
+void ProbeHistory::save(void) const {
+    if (!this->modified) {
+        return;
+    }
+    const auto state_dir = get_node_state_dir(true);
+    if (!state_dir) {
+        return;
+    }
+
+    // Keep only the most recently probed records
+    std::vector<std::pair<const std::filesystem::path *, const ProbeRecord *>>
+        sorted;
+    sorted.reserve(this->records.size());
+    for (const auto &[path, record] : this->records) {
+        if (path.native().find('\n') == std::string::npos) {
+            sorted.emplace_back(&path, &record);
+        }
+    }
+    std::ranges::sort(sorted, [](const auto &lhs, const auto &rhs) {
+        if (lhs.second->last_probed != rhs.second->last_probed) {
+            return lhs.second->last_probed > rhs.second->last_probed;
+        }
+        return *lhs.first < *rhs.first;
+    });
+    if (sorted.size() > HISTORY_MAX_RECORDS) {
+        sorted.resize(HISTORY_MAX_RECORDS);
+    }
+
+    // Write to a temporary file and rename it into place so concurrent runs
+    // never see a partial file
+    const auto file_path = *state_dir / HISTORY_FILENAME;
+    const auto tmp_path =
+        *state_dir / std::format("{}.{}", HISTORY_FILENAME, ::getpid());
+    std::error_code ec;
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        file << HISTORY_FORMAT << '\n';
+        for (const auto &[path, record] : sorted) {
+            file << std::format("{:016x} {} {} {} {} {} ", record->fingerprint,
+                                record->version, record->probe_time.count(),
+                                record->wins, record->losses,
+                                record->last_probed)
+                 << path->native() << '\n';
+        }
+        file.close();
+        if (!file) {
+            log_debug("{}: write error", tmp_path);
+            std::filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp_path, file_path, ec);
+    if (ec) {
+        log_debug("{}: {}", file_path, ec.message());
+        std::filesystem::remove(tmp_path, ec);
+    }
+}
+
+const ProbeRecord *
+ProbeHistory::find(const std::filesystem::path &libcuda_path) const {
+    const auto record = this->records.find(libcuda_path);
+    return record == this->records.end() ? nullptr : &record->second;
+}
+
+std::optional<int>
+ProbeHistory::known_version(const std::filesystem::path &libcuda_path,
+                            uint64_t fingerprint) const {
+    const auto *record = this->find(libcuda_path);
+    if (record == nullptr || fingerprint == 0 ||
+        record->fingerprint != fingerprint || record->version < 0) {
+        return std::nullopt;
+    }
+    return record->version;
+}
+
+void ProbeHistory::record_probe(const std::filesystem::path &libcuda_path,
+                                uint64_t fingerprint, int version,
+                                std::chrono::microseconds probe_time) {
+    auto [entry, inserted] = this->records.try_emplace(libcuda_path);
+    auto &record = entry->second;
+    if (!inserted && record.fingerprint != fingerprint) {
+        // A different file now so nothing learned about the old one applies
+        record = ProbeRecord{};
+        inserted = true;
+    }
+
+    record.fingerprint = fingerprint;
+    record.version = version;
+    record.probe_time =
+        inserted ? probe_time
+                 : (record.probe_time * (8 - PROBE_TIME_WEIGHT) +
+                    probe_time * PROBE_TIME_WEIGHT) /
+                       8;
+    record.last_probed = unix_time_now();
+    this->modified = true;
+}
+
+void ProbeHistory::record_outcome(const std::filesystem::path &libcuda_path,
+                                  bool won) {
+    const auto entry = this->records.find(libcuda_path);
+    if (entry == this->records.end()) {
+        return;
+    }
+    ++(won ? entry->second.wins : entry->second.losses);
+    this->modified = true;
+}
+
+} // namespace autocompat
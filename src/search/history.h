@@ -0,0 +1,77 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_HISTORY_H
+#define CUDA_AUTOCOMPAT_SEARCH_HISTORY_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <unordered_map>
+
+namespace autocompat {
+
+// What previous runs on this node learned about probing a libcuda.so.1
+struct ProbeRecord {
+    // Fingerprint of the libcuda.so.1 the version was recorded for; see
+    // fingerprint.h
+    uint64_t fingerprint = 0;
+
+    // cuDriverGetVersion, or -1 if the candidate failed validation
+    int version = -1;
+
+    // Moving average of how long probing took
+    std::chrono::microseconds probe_time{};
+
+    // How many runs selected or rejected the candidate after validating it
+    unsigned int wins = 0;
+    unsigned int losses = 0;
+
+    // Unix time of the most recent probe, used to expire old records
+    int64_t last_probed = 0;
+};
+
+// A small per-node history of probe outcomes kept in the node state
+// directory.  The history only changes the order candidates are probed in
+// and lets probes be skipped when a recorded version proves they can't be
+// selected; the selected driver is the same as it would be without it.
+class ProbeHistory {
+  public:
+    void load(void);
+    void save(void) const;
+
+    const ProbeRecord *find(const std::filesystem::path &libcuda_path) const;
+
+    // The recorded version of libcuda_path if it's still the same file
+    std::optional<int> known_version(const std::filesystem::path &libcuda_path,
+                                     uint64_t fingerprint) const;
+
+    void record_probe(const std::filesystem::path &libcuda_path,
+                      uint64_t fingerprint, int version,
+                      std::chrono::microseconds probe_time);
+
+    void record_outcome(const std::filesystem::path &libcuda_path, bool won);
+
+    bool empty(void) const { return this->records.empty(); }
+
+  private:
+    std::unordered_map<std::filesystem::path, ProbeRecord> records;
+    bool modified = false;
+};
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_HISTORY_H
@@ -17,10 +17,14 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
 #include <format>
 #include <string>
 
+#include "admin_config.h"
+#include "deadline.h"
 #include "logging.h"
+#include "search.h"
 
 namespace autocompat {
 
@@ -44,4 +48,35 @@ void init_logging(void) {
     }
 }
 
+void init_deadline(void) {
+    const char *env_val = secure_getenv("CUDA_AUTOCOMPAT_DEADLINE_MS");
+    if (env_val == nullptr || env_val[0] == '\0') {
+        return;
+    }
+
+    std::chrono::milliseconds budget{};
+    if (!parse_deadline_ms(env_val, budget)) {
+        log_warn("CUDA_AUTOCOMPAT_DEADLINE_MS: Invalid value, ignoring");
+        return;
+    }
+    SEARCH_DEADLINE.set_budget(budget);
+}
+
+void init_admin_config(void) {
+    const char *path = get_admin_config_path();
+    if (path == nullptr) {
+        return;
+    }
+
+    const int err = load_admin_config(path, &ADMIN_CONFIG);
+    if (err < 0) {
+        log_warn("{}: Failed to read admin configuration, ignoring", path);
+    } else if (err > 0) {
+        log_warn("{}:{}: Invalid setting, ignoring admin configuration", path,
+                 err);
+    } else if (ADMIN_CONFIG.map != nullptr) {
+        log_info("Using admin configuration {}", path);
+    }
+}
+
 } // namespace autocompat
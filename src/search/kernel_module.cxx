@@ -0,0 +1,113 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kernel_module.h"
+
+#include <cstdlib>
+
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+#include "logging.h"
+
+namespace autocompat {
+
+namespace {
+
+std::optional<std::string> read_file(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    if (!file) {
+        return std::nullopt;
+    }
+    log_trace("read({})", path);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+}
+
+// The first line of /proc/driver/nvidia/version looks like:
+//
+//   NVRM version: NVIDIA UNIX x86_64 Kernel Module  550.54.15  Tue Mar ...
+//   NVRM version: NVIDIA UNIX Open Kernel Module for x86_64  570.86.15  ...
+//
+// so the version is the first field after "Module" starting with a digit
+std::optional<DriverVersion> parse_proc_version(std::string_view src) {
+    const auto line_end = src.find('\n');
+    src = src.substr(0, line_end);
+    const auto module_pos = src.find("Module");
+    if (module_pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+    src.remove_prefix(module_pos);
+    while (!src.empty()) {
+        const auto field_pos = src.find(' ');
+        if (field_pos == std::string_view::npos) {
+            break;
+        }
+        src.remove_prefix(field_pos + 1);
+        if (!src.empty() && src.front() >= '0' && src.front() <= '9') {
+            return parse_driver_version(src);
+        }
+    }
+    return std::nullopt;
+}
+
+} // end anonymous namespace
+
+std::optional<DriverVersion> parse_driver_version(std::string_view src) {
+    DriverVersion ver{};
+    const char *cursor = src.data();
+    const char *const end = src.data() + src.size();
+    size_t num_parsed = 0;
+    for (; num_parsed < ver.size(); ++num_parsed) {
+        auto [ptr, ec] = std::from_chars(cursor, end, ver.at(num_parsed));
+        if (ec != std::errc{}) {
+            return std::nullopt;
+        }
+        cursor = ptr;
+        if (cursor == end || *cursor != '.') {
+            ++num_parsed;
+            break;
+        }
+        ++cursor;
+    }
+    if (num_parsed < 2) {
+        return std::nullopt;
+    }
+    return ver;
+}
+
+std::optional<DriverVersion> read_kernel_module_version(void) {
+    std::filesystem::path sysroot{"/"};
+    const char *env_value = secure_getenv("CUDA_AUTOCOMPAT_SYSROOT");
+    if (env_value != nullptr && env_value[0] != '\0') {
+        sysroot = env_value;
+    }
+
+    if (const auto sys_version =
+            read_file(sysroot / "sys/module/nvidia/version")) {
+        return parse_driver_version(*sys_version);
+    }
+    if (const auto proc_version =
+            read_file(sysroot / "proc/driver/nvidia/version")) {
+        return parse_proc_version(*proc_version);
+    }
+    return std::nullopt;
+}
+
+} // namespace autocompat
@@ -0,0 +1,38 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_SEARCH_KERNEL_MODULE_H
+#define CUDA_AUTOCOMPAT_SEARCH_KERNEL_MODULE_H
+
+#include <optional>
+#include <string_view>
+
+#include "driver_versions.h"
+
+namespace autocompat {
+
+// Version of the loaded nvidia kernel module from /sys/module/nvidia/version,
+// or failing that /proc/driver/nvidia/version.  Both are looked for under
+// CUDA_AUTOCOMPAT_SYSROOT if set, i.e. to test with a fake tree.
+//
+// return:
+//   The version; std::nullopt if the module isn't loaded
+std::optional<DriverVersion> read_kernel_module_version(void);
+
+// Parse a MAJOR.MINOR[.PATCH] driver version from the start of src
+std::optional<DriverVersion> parse_driver_version(std::string_view src);
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_KERNEL_MODULE_H
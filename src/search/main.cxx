@@ -15,15 +15,28 @@
 
 #include <cstdlib>
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
+#include <format>
 #include <iostream>
 #include <optional>
 #include <span>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+#include "deadline.h"
 #include "logging.h"
+#include "kernel_module.h"
+#include "materialize.h"
+#include "materialized.h"
+#include "metrics.h"
+#include "metrics_export.h"
+#include "node_state.h"
+#include "prefetch.h"
+#include "search_protocol.h"
+#include "stage.h"
 #include "version.h"
 
 #include "search.h"
@@ -31,10 +44,11 @@
 namespace autocompat {
 
 void init_logging(void);
+void init_deadline(void);
+void init_admin_config(void);
 
-bool parse_args(std::span<char *> argv,
-                std::vector<std::filesystem::path> &search_paths,
-                std::vector<std::filesystem::path> &search_libs);
+bool parse_args(std::span<char *> argv, SearchOptions &options,
+                const std::unordered_set<std::filesystem::path> &slow_paths);
 
 } // namespace autocompat
 
@@ -43,42 +57,192 @@ inline auto parse_libcuda_version(int ver) {
     return std::to_array({ver / 1000, (ver % 100) / 10, ver % 10});
 }
 
+// Write the ranked results in the format described in search_protocol.h
+void write_ranked_results(const std::vector<autocompat::SearchResult> &ranked) {
+    using namespace autocompat;
+
+    const auto put = [](const auto &field) { std::cout << field << '\0'; };
+
+    put(AUTOCOMPAT_RESULTS_MAGIC);
+    put(AUTOCOMPAT_RESULTS_FORMAT);
+    put(ranked.size());
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        const auto &result = ranked[i];
+        log_info("Result {}: {} {}", i, result.version, result.driver_dir);
+        put(result.version);
+        put(std::format("{:016x}", result.fingerprint));
+        put((result.driver_dir / "libcuda.so.1").native());
+        put((result.driver_dir / "libnvidia-nvvm.so.4").native());
+        put((result.driver_dir / "libnvidia-ptxjitcompiler.so.1").native());
+        put((result.driver_dir / "libcudadebugger.so.1").native());
+    }
+    std::cout << std::flush;
+}
+
+// Exit once the results are written.  An abandoned probe may still be
+// running a driver's constructor on the deadline's worker thread, holding
+// the dynamic linker's lock that exit would wait on to run the libraries'
+// destructors, so then the helper exits without running them.
+int exit_search(int status) {
+    if (!autocompat::SEARCH_DEADLINE.get_abandoned().empty()) {
+        std::cout.flush();
+        std::cerr.flush();
+        std::_Exit(status);
+    }
+    return status;
+}
+
 int main(int argc, char *argv[]) {
     using namespace autocompat;
 
+    const uint64_t start_us = autocompat_metrics_now_us();
+    (void)setenv(AUTOCOMPAT_HELPER_ENV, "1", 1);
+
     init_logging();
+    init_deadline();
+    init_admin_config();
 
     log_info("CUDA AutoCompat v{}", CUDA_AUTOCOMPAT_VERSION_STRING);
 
-    std::vector<std::filesystem::path> search_paths;
-    std::vector<std::filesystem::path> search_libs;
-    if (!parse_args({argv, static_cast<size_t>(argc)}, search_paths,
-                    search_libs)) {
+    SearchState state;
+    state.slow_paths = load_slow_paths();
+    state.history.load();
+    state.kernel_module = read_kernel_module_version();
+    if (state.kernel_module) {
+        log_info("Kernel module version: {}.{}.{}", state.kernel_module->at(0),
+                 state.kernel_module->at(1), state.kernel_module->at(2));
+    }
+    SearchOptions options;
+    if (!parse_args({argv, static_cast<size_t>(argc)}, options,
+                    state.slow_paths)) {
         return EXIT_FAILURE;
     }
+    state.min_version = options.min_version;
+    state.num_wanted = static_cast<size_t>(std::max(options.num_ranked, 1));
+
+    if (options.mode == SearchMode::metrics) {
+        if (!write_metrics(std::cout)) {
+            log_error("Metrics are disabled or invalid");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
 
-    SearchState state;
+    // Checking a materialized directory is meant to be cheap enough for a
+    // job prolog to run before deciding whether to rebuild it
+    if (options.mode == SearchMode::check) {
+        const auto &dir = options.materialize_dir.native();
+        const int current =
+            check_materialized_dir(dir.data(), static_cast<int>(dir.size()));
+        log_info("Materialized directory {} is {}", options.materialize_dir,
+                 current > 0 ? "current" : current == 0 ? "stale" : "missing");
+        return current > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     log_info("Searching for best available libcuda.so.1");
 
-    search_libraries_libcuda(search_libs, state);
+    // An already loaded or pinned driver is used as-is, and the full search
+    // is only needed if none of the priority paths has a driver, or one new
+    // enough when there's a minimum
+    search_libraries_libcuda(options.search_libs, state);
     if (!state.found) {
-        search_libraries_libcudart(search_libs, state);
+        search_pinned_driver(state);
+    }
+    bool done = state.found.has_value();
+    if (!done) {
+        find_required_version(options.search_libs, state);
+        search_priority_paths(state);
+        done = state.found &&
+               (state.min_version <= 0 || state.satisfied());
+    }
+    if (!done && state.min_version > 0) {
+        // Goal-directed search: check the cheapest candidates, i.e. the
+        // system driver, first and stop as soon as one is new enough so the
+        // compat libraries are only loaded when they're actually needed
+        log_info("Searching for libcuda.so.1 supporting at least {}",
+                 state.min_version);
+        search_paths_libcuda(options.search_paths, state);
+        search_libraries_libcudart(options.search_libs, state);
+        search_cuda_home(state);
+        search_paths_libcudart(options.search_paths, state);
+        search_toolkit_prefixes(state);
+        probe_candidates(state);
+        if (state.found && !state.meets_minimum()) {
+            log_warn("No driver supports the minimum required version {}; "
+                     "using the newest available",
+                     state.min_version);
+        }
+    } else if (!done) {
+        search_libraries_libcudart(options.search_libs, state);
         search_cuda_home(state);
-        search_paths_libcudart(search_paths, state);
-        search_paths_libcuda(search_paths, state);
+        search_paths_libcudart(options.search_paths, state);
+        search_toolkit_prefixes(state);
+        search_paths_libcuda(options.search_paths, state);
+        probe_candidates(state);
     }
 
     log_info("Search complete");
 
+    // The loaders are given a node-local copy of the selected driver if the
+    // admin configuration stages it.  Otherwise get the driver into the page
+    // cache while the rest of the search's bookkeeping runs and the caller
+    // carries on with its startup.
+    std::optional<SearchResult> staged;
+    if (state.found) {
+        staged = stage_driver(*state.found);
+        if (!staged) {
+            autocompat_prefetch_file(
+                (state.found->driver_dir / "libcuda.so.1").c_str());
+        }
+    }
+
+    if (SEARCH_DEADLINE.enabled()) {
+        for (const auto &path : SEARCH_DEADLINE.get_abandoned()) {
+            log_warn("Abandoned at deadline: {}", path);
+        }
+        for (const auto &path : SEARCH_DEADLINE.get_skipped()) {
+            log_warn("Skipped at deadline: {}", path);
+        }
+        save_slow_paths(SEARCH_DEADLINE.get_abandoned(), state.probed_dirs);
+    }
+
+    record_history(state);
+    state.history.save();
+    autocompat_metrics_record_search(state.found.has_value(), state.num_probed,
+                                     state.num_pruned,
+                                     autocompat_metrics_now_us() - start_us);
+
     if (state.found) {
         const auto found_ver = parse_libcuda_version(state.found->version);
         log_info("Found library: {}/libcuda.so.1", state.found->driver_dir);
-        log_info("Found version: {}.{}.{}", found_ver[0], found_ver[1], found_ver[2]);
-        std::cout << state.found->driver_dir.native() << std::flush;
-        return EXIT_SUCCESS;
+        if (state.found->version > 0) {
+            log_info("Found version: {}.{}.{}", found_ver[0], found_ver[1],
+                     found_ver[2]);
+        } else {
+            log_info("Found version: unknown (not probed)");
+        }
+        if (options.mode == SearchMode::materialize) {
+            const auto &selected = staged ? *staged : *state.found;
+            if (!materialize_driver(selected, options.materialize_dir)) {
+                return exit_search(EXIT_FAILURE);
+            }
+            std::cout << options.materialize_dir.native() << std::flush;
+        } else if (options.num_ranked > 0) {
+            auto ranked =
+                rank_results(state, static_cast<size_t>(options.num_ranked));
+            for (auto &result : ranked) {
+                if (staged && result.driver_dir == state.found->driver_dir) {
+                    result = *staged;
+                }
+            }
+            write_ranked_results(ranked);
+        } else {
+            const auto &selected = staged ? *staged : *state.found;
+            std::cout << selected.driver_dir.native() << std::flush;
+        }
+        return exit_search(EXIT_SUCCESS);
     }
     log_info("No usable library found");
 
-    return EXIT_FAILURE;
+    return exit_search(EXIT_FAILURE);
 }
@@ -0,0 +1,228 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "materialize.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "driver_libs.h"
+#include "fingerprint.h"
+#include "logging.h"
+#include "materialized.h"
+
+namespace autocompat {
+
+namespace {
+
+bool is_current(const std::filesystem::path &dir,
+                const std::filesystem::path &driver_dir) {
+    std::error_code ec;
+    const auto target = std::filesystem::read_symlink(dir / "libcuda.so.1", ec);
+    const auto &dir_str = dir.native();
+    return !ec && target == driver_dir / "libcuda.so.1" &&
+           check_materialized_dir(dir_str.data(),
+                                  static_cast<int>(dir_str.size())) == 1;
+}
+
+// Get the manifest for the libraries the driver directory has, along with
+// their sonames
+bool get_manifest(const std::filesystem::path &driver_dir,
+                  std::string &manifest, std::vector<const char *> &libs) {
+    constexpr std::array<const char *, DRIVER_LIB_COUNT> sonames =
+        DRIVER_LIB_SONAMES_INIT;
+
+    manifest = std::format("{} {}\ndriver {}\n", MATERIALIZED_MAGIC,
+                           MATERIALIZED_FORMAT, driver_dir);
+    for (size_t lib = 0; lib < sonames.size(); ++lib) {
+        const auto src = driver_dir / sonames[lib];
+        struct stat lib_stat{};
+        if (::stat(src.c_str(), &lib_stat) != 0) {
+            if (lib >= DRIVER_LIB_REQUIRED_COUNT && errno == ENOENT) {
+                continue;
+            }
+            log_warn("{}: {}", src, std::strerror(errno));
+            return false;
+        }
+        const uint64_t fingerprint = autocompat_fingerprint(
+            lib_stat.st_dev, lib_stat.st_ino, lib_stat.st_size,
+            lib_stat.st_mtim.tv_sec, lib_stat.st_mtim.tv_nsec);
+        manifest += std::format("{:016x} {}\n", fingerprint, sonames[lib]);
+        libs.push_back(sonames[lib]);
+    }
+    return true;
+}
+
+// Build a materialized directory in a private directory and rename it into
+// place so it's never seen partially built
+bool build_dir(const std::filesystem::path &driver_dir,
+               const std::string &manifest,
+               const std::vector<const char *> &libs,
+               const std::filesystem::path &dst_dir) {
+    const auto tmp_dir = std::format("{}.{}", dst_dir, ::getpid());
+    std::error_code ec;
+    std::filesystem::remove_all(tmp_dir, ec);
+    std::filesystem::create_directory(tmp_dir, ec);
+    bool built = !ec;
+    for (const auto *soname : libs) {
+        if (!built) {
+            break;
+        }
+        std::filesystem::create_symlink(driver_dir / soname,
+                                        std::filesystem::path(tmp_dir) / soname,
+                                        ec);
+        built = !ec;
+    }
+    if (built) {
+        std::ofstream out(std::filesystem::path(tmp_dir) /
+                          MATERIALIZED_MANIFEST);
+        out << manifest;
+        out.close();
+        built = !out.fail();
+    }
+    if (built) {
+        std::filesystem::rename(tmp_dir, dst_dir, ec);
+        built = !ec;
+    }
+    if (!built) {
+        log_warn("{}: {}", dst_dir,
+                 ec ? ec.message() : "Failed to write manifest");
+    }
+    std::filesystem::remove_all(tmp_dir, ec);
+    return built;
+}
+
+// Point dir at the sibling directory named target with a rename, so it's
+// never missing either
+bool swap_link(const std::filesystem::path &dir,
+               const std::filesystem::path &target) {
+    const auto tmp_link = std::format("{}.link.{}", dir, ::getpid());
+    std::error_code ec;
+    std::filesystem::remove(tmp_link, ec);
+    std::filesystem::create_symlink(target, tmp_link, ec);
+    if (!ec) {
+        std::filesystem::rename(tmp_link, dir, ec);
+    }
+    if (ec) {
+        log_warn("{}: {}", dir, ec.message());
+        std::filesystem::remove(tmp_link, ec);
+        return false;
+    }
+    return true;
+}
+
+bool rebuild(const std::filesystem::path &driver_dir,
+             const std::filesystem::path &dir) {
+    std::string manifest;
+    std::vector<const char *> libs;
+    if (!get_manifest(driver_dir, manifest, libs)) {
+        return false;
+    }
+
+    // Directories are named for their contents so switching back to a
+    // previous driver reuses its directory if it's still there
+    const uint64_t key = autocompat_fnv1a(AUTOCOMPAT_FNV1A_INIT,
+                                          manifest.data(), manifest.size());
+    const auto target = std::filesystem::path(
+        std::format("{}.{:016x}", dir.filename(), key));
+    const auto target_dir = dir.parent_path() / target;
+    std::error_code ec;
+    if (!std::filesystem::exists(target_dir / MATERIALIZED_MANIFEST, ec) &&
+        !build_dir(driver_dir, manifest, libs, target_dir)) {
+        return false;
+    }
+
+    const auto old_target = std::filesystem::read_symlink(dir, ec);
+    if (!swap_link(dir, target)) {
+        return false;
+    }
+
+    // Only remove directories this created, i.e. not an admin's symlink to
+    // somewhere else
+    if (!old_target.empty() && old_target != target &&
+        old_target.parent_path().empty() &&
+        old_target.native().starts_with(std::format("{}.", dir.filename()))) {
+        std::filesystem::remove_all(dir.parent_path() / old_target, ec);
+    }
+    return true;
+}
+
+} // end anonymous namespace
+
+bool materialize_driver(const SearchResult &result,
+                        const std::filesystem::path &dir) {
+    std::error_code ec;
+    const auto driver_dir = std::filesystem::absolute(result.driver_dir, ec);
+    if (ec) {
+        log_warn("{}: {}", result.driver_dir, ec.message());
+        return false;
+    }
+
+    // A pin of the materialized directory itself only finds it when it's
+    // current
+    const auto canonical_dir = std::filesystem::weakly_canonical(dir, ec);
+    const bool is_pinned =
+        !ec && std::filesystem::weakly_canonical(driver_dir, ec) ==
+                   canonical_dir && !ec;
+    if (is_pinned || is_current(dir, driver_dir)) {
+        log_info("Materialized directory {} is current", dir);
+        return true;
+    }
+
+    const auto dir_status = std::filesystem::symlink_status(dir, ec);
+    if (std::filesystem::exists(dir_status) &&
+        !std::filesystem::is_symlink(dir_status)) {
+        log_error("{}: Exists and isn't a materialized directory", dir);
+        return false;
+    }
+
+    // Only one process rebuilds the directory while the rest wait on the lock
+    // and then use what it built
+    const auto lock_path = std::format("{}.lock", dir);
+    const int lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                               S_IRUSR | S_IWUSR);
+    if (lock_fd < 0) {
+        log_warn("{}: {}", lock_path, std::strerror(errno));
+        return false;
+    }
+    while (::flock(lock_fd, LOCK_EX) != 0 && errno == EINTR) {
+    }
+
+    bool current = is_current(dir, driver_dir);
+    if (current) {
+        log_info("Materialized directory {} is current", dir);
+    } else {
+        log_info("Materializing {} to {}", driver_dir, dir);
+        current = rebuild(driver_dir, dir);
+    }
+
+    (void)::close(lock_fd);
+    return current;
+}
+
+} // namespace autocompat
@@ -0,0 +1,38 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_MATERIALIZE_H
+#define CUDA_AUTOCOMPAT_SEARCH_MATERIALIZE_H
+
+#include <filesystem>
+
+#include "search.h"
+
+namespace autocompat {
+
+// Point the materialized driver directory dir at a result's libraries; see
+// materialized.h.  dir is a symlink to a sibling directory named for a hash
+// of its manifest, so a rebuild is swapped into place with a rename and dir
+// is never seen partially built, and rebuilds are made by one process at a
+// time.  dir is left untouched if it's already current for the result.
+//
+// return:
+//   true if dir is current for the result
+bool materialize_driver(const SearchResult &result,
+                        const std::filesystem::path &dir);
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_MATERIALIZE_H
@@ -0,0 +1,140 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics_export.h"
+
+#include <array>
+#include <cstdint>
+#include <format>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "metrics.h"
+
+namespace autocompat {
+
+namespace {
+
+constexpr std::array<std::string_view, AUTOCOMPAT_METRICS_LOADER_COUNT>
+    LOADER_NAMES = {"audit", "ifunc"};
+constexpr std::array<std::string_view, AUTOCOMPAT_METRICS_OUTCOME_COUNT>
+    OUTCOME_NAMES = {"pinned", "cached", "searched", "failed"};
+
+constexpr double US_PER_SECOND = 1e6;
+
+void write_header(std::ostream &out, std::string_view name,
+                  std::string_view type, std::string_view help) {
+    out << std::format("# HELP cuda_autocompat_{} {}\n", name, help)
+        << std::format("# TYPE cuda_autocompat_{} {}\n", name, type);
+}
+
+void write_counter(std::ostream &out, std::string_view name,
+                   std::string_view help, uint64_t value) {
+    write_header(out, name, "counter", help);
+    out << std::format("cuda_autocompat_{} {}\n", name, value);
+}
+
+// Write a histogram's samples, where labels are any to add to each, i.e.
+// 'loader="audit"'
+void write_histogram(std::ostream &out, std::string_view name,
+                     std::string_view labels,
+                     const autocompat_histogram &histogram) {
+    constexpr std::array<uint64_t, AUTOCOMPAT_METRICS_BUCKET_COUNT - 1>
+        bounds = AUTOCOMPAT_METRICS_BUCKET_BOUNDS_INIT;
+
+    const auto bucket_labels =
+        labels.empty() ? std::string() : std::format("{},", labels);
+    const auto total_labels =
+        labels.empty() ? std::string() : std::format("{{{}}}", labels);
+    uint64_t cumulative = 0;
+    for (size_t bucket = 0; bucket < bounds.size(); ++bucket) {
+        cumulative += histogram.buckets[bucket];
+        out << std::format("cuda_autocompat_{}_bucket{{{}le=\"{}\"}} {}\n",
+                           name, bucket_labels,
+                           static_cast<double>(bounds[bucket]) / US_PER_SECOND,
+                           cumulative);
+    }
+    out << std::format("cuda_autocompat_{}_bucket{{{}le=\"+Inf\"}} {}\n", name,
+                       bucket_labels, histogram.count)
+        << std::format("cuda_autocompat_{}_sum{} {}\n", name, total_labels,
+                       static_cast<double>(histogram.sum_us) / US_PER_SECOND)
+        << std::format("cuda_autocompat_{}_count{} {}\n", name, total_labels,
+                       histogram.count);
+}
+
+} // end anonymous namespace
+
+bool write_metrics(std::ostream &out) {
+    autocompat_metrics metrics;
+    if (!autocompat_metrics_read(&metrics)) {
+        return false;
+    }
+
+    write_header(out, "resolutions_total", "counter",
+                 "Driver resolutions by the loader libraries.");
+    for (size_t loader = 0; loader < LOADER_NAMES.size(); ++loader) {
+        for (size_t outcome = 0; outcome < OUTCOME_NAMES.size(); ++outcome) {
+            out << std::format(
+                "cuda_autocompat_resolutions_total{{loader=\"{}\","
+                "outcome=\"{}\"}} {}\n",
+                LOADER_NAMES[loader], OUTCOME_NAMES[outcome],
+                metrics.resolutions[loader][outcome]);
+        }
+    }
+
+    write_header(out, "resolution_seconds", "histogram",
+                 "Time processes waited for the driver to be resolved.");
+    for (size_t loader = 0; loader < LOADER_NAMES.size(); ++loader) {
+        write_histogram(out, "resolution_seconds",
+                        std::format("loader=\"{}\"", LOADER_NAMES[loader]),
+                        metrics.resolution_time[loader]);
+    }
+
+    write_header(out, "driver_selections_total", "counter",
+                 "Drivers selected by the loader libraries by version.");
+    for (const auto &slot : metrics.versions) {
+        if (slot.version == 0) {
+            continue;
+        }
+        const auto version = slot.version - 1;
+        out << std::format(
+            "cuda_autocompat_driver_selections_total{{version=\"{}\"}} {}\n",
+            version == 0 ? std::string("unknown") : std::to_string(version),
+            slot.count);
+    }
+    out << std::format(
+        "cuda_autocompat_driver_selections_total{{version=\"other\"}} {}\n",
+        metrics.other_versions);
+
+    write_counter(out, "searches_total", "Searches run by the helper.",
+                  metrics.searches);
+    write_counter(out, "search_failures_total",
+                  "Helper searches that found no usable driver.",
+                  metrics.search_failures);
+    write_counter(out, "probes_total", "Drivers loaded to probe their version.",
+                  metrics.probes);
+    write_counter(out, "pruned_total",
+                  "Candidates skipped since they couldn't be selected.",
+                  metrics.pruned);
+    write_header(out, "search_seconds", "histogram",
+                 "Time taken by the helper's searches.");
+    write_histogram(out, "search_seconds", "", metrics.search_time);
+
+    out << std::flush;
+    return true;
+}
+
+} // namespace autocompat
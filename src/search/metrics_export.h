@@ -0,0 +1,32 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_METRICS_EXPORT_H
+#define CUDA_AUTOCOMPAT_SEARCH_METRICS_EXPORT_H
+
+#include <ostream>
+
+namespace autocompat {
+
+// Write the node's metrics, see metrics.h, in the Prometheus text format
+// read by node_exporter's textfile collector
+//
+// return:
+//   false if metrics are disabled or the segment is invalid
+bool write_metrics(std::ostream &out);
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_METRICS_EXPORT_H
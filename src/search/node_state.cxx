@@ -0,0 +1,186 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "node_state.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+#include "logging.h"
+
+namespace autocompat {
+
+namespace {
+
+constexpr auto SLOW_PATHS_FILENAME = "slow_paths";
+
+// How long a path that was never probed again is still tried last, so one
+// that was only slow once doesn't stay at the end of the search forever
+constexpr std::chrono::seconds SLOW_PATH_EXPIRY = std::chrono::days{1};
+
+int64_t unix_time_now(void) {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Read the slow paths with when each was last abandoned, one
+// "<unix time> <path>" per line, dropping any that have expired
+std::unordered_map<std::filesystem::path, int64_t>
+read_slow_paths(const std::filesystem::path &state_dir) {
+    std::unordered_map<std::filesystem::path, int64_t> paths;
+    const int64_t oldest = unix_time_now() - SLOW_PATH_EXPIRY.count();
+
+    std::ifstream file(state_dir / SLOW_PATHS_FILENAME);
+    for (std::string line; std::getline(file, line);) {
+        const auto sep = line.find(' ');
+        if (sep == std::string::npos || sep + 1 == line.size()) {
+            continue;
+        }
+        int64_t abandoned_at = 0;
+        const auto [ptr, ec] =
+            std::from_chars(line.data(), line.data() + sep, abandoned_at);
+        if (ec != std::errc{} || ptr != line.data() + sep) {
+            continue;
+        }
+        std::filesystem::path path = std::string_view(line).substr(sep + 1);
+        if (abandoned_at < oldest) {
+            log_debug("slow path {} (expired)", path);
+            continue;
+        }
+        paths.insert_or_assign(std::move(path), abandoned_at);
+    }
+    return paths;
+}
+
+} // end anonymous namespace
+
+std::optional<std::filesystem::path> get_node_state_dir(bool create) {
+    std::filesystem::path state_dir;
+    const char *env_value = secure_getenv("CUDA_AUTOCOMPAT_STATE_DIR");
+    if (env_value != nullptr) {
+        if (env_value[0] == '\0') {
+            return std::nullopt;
+        }
+        state_dir = env_value;
+    } else {
+        state_dir = std::format("/var/tmp/cuda-autocompat-{}", ::getuid());
+    }
+
+    if (create) {
+        std::error_code ec;
+        std::filesystem::create_directories(state_dir.parent_path(), ec);
+        if (::mkdir(state_dir.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+            log_debug("{}: {}", state_dir, std::strerror(errno));
+            return std::nullopt;
+        }
+    }
+
+    // The state decides which drivers are tried and which are skipped, so
+    // it's only trusted from a real directory only the user can write to
+    struct stat dir_stat{};
+    if (::lstat(state_dir.c_str(), &dir_stat) != 0) {
+        return std::nullopt;
+    }
+    if (!S_ISDIR(dir_stat.st_mode) || dir_stat.st_uid != ::getuid() ||
+        (dir_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        log_warn("{}: Not a private directory, ignoring saved state",
+                 state_dir);
+        return std::nullopt;
+    }
+    return state_dir;
+}
+
+std::unordered_set<std::filesystem::path> load_slow_paths(void) {
+    std::unordered_set<std::filesystem::path> paths;
+
+    const auto state_dir = get_node_state_dir(false);
+    if (!state_dir) {
+        return paths;
+    }
+
+    for (auto &entry : read_slow_paths(*state_dir)) {
+        log_debug("slow path {}", entry.first);
+        paths.insert(entry.first);
+    }
+    return paths;
+}
+
+void save_slow_paths(
+    const std::vector<std::filesystem::path> &abandoned,
+    const std::unordered_set<std::filesystem::path> &completed) {
+    const auto state_dir = get_node_state_dir(!abandoned.empty());
+    if (!state_dir) {
+        return;
+    }
+
+    // Merge with the paths already recorded, re-read rather than the set
+    // loaded at startup to keep any added by concurrent runs, so a path is
+    // only forgotten once it's been probed in time or has expired
+    auto paths = read_slow_paths(*state_dir);
+    std::erase_if(paths, [&](const auto &entry) {
+        return completed.contains(entry.first);
+    });
+    const int64_t now = unix_time_now();
+    for (const auto &path : abandoned) {
+        paths.insert_or_assign(path, now);
+    }
+
+    const auto file_path = *state_dir / SLOW_PATHS_FILENAME;
+    std::error_code ec;
+    if (paths.empty()) {
+        std::filesystem::remove(file_path, ec);
+        return;
+    }
+
+    // Write to a temporary file and rename it into place so concurrent runs
+    // never see a partial file
+    const auto tmp_path =
+        *state_dir / std::format("{}.{}", SLOW_PATHS_FILENAME, ::getpid());
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        for (const auto &[path, abandoned_at] : paths) {
+            if (path.native().find('\n') == std::string::npos) {
+                file << abandoned_at << ' ' << path.native() << '\n';
+            }
+        }
+        file.close();
+        if (!file) {
+            log_debug("{}: write error", tmp_path);
+            std::filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp_path, file_path, ec);
+    if (ec) {
+        log_debug("{}: {}", file_path, ec.message());
+        std::filesystem::remove(tmp_path, ec);
+    }
+}
+
+} // namespace autocompat
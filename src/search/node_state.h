@@ -0,0 +1,45 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_NODE_STATE_H
+#define CUDA_AUTOCOMPAT_SEARCH_NODE_STATE_H
+
+#include <filesystem>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+namespace autocompat {
+
+// State the helper keeps between runs lives in a node-local directory,
+// CUDA_AUTOCOMPAT_STATE_DIR if set and /var/tmp/cuda-autocompat-<uid>
+// otherwise, which must be owned by and only writable by the user.  None of
+// it is required; any errors reading or writing it just fall back to the
+// default behavior.
+std::optional<std::filesystem::path> get_node_state_dir(bool create);
+
+// Paths abandoned at the search deadline by earlier runs, which are tried
+// last so a hung mount can't use up the budget of every run
+std::unordered_set<std::filesystem::path> load_slow_paths(void);
+
+// Add the paths abandoned by this run and forget those it completed within
+// the deadline.  Paths this run never reached are kept until they expire.
+void save_slow_paths(
+    const std::vector<std::filesystem::path> &abandoned,
+    const std::unordered_set<std::filesystem::path> &completed);
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_NODE_STATE_H
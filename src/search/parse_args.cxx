@@ -20,6 +20,8 @@
 
 #include <algorithm>
 #include <array>
+#include <charconv>
+#include <chrono>
 #include <filesystem>
 #include <format>
 #include <iostream>
@@ -28,11 +30,14 @@
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <utility>
 #include <vector>
 #include <unordered_set>
 
+#include "deadline.h"
 #include "logging.h"
+#include "search.h"
 
 namespace autocompat {
 
@@ -49,6 +54,20 @@ constexpr std::array CMD_FLAGS = {
     CmdFlag{'p', "search-path", "PATH", "Colon-separated library search path."},
     CmdFlag{'l', "libs", "LIBRARIES",
             "Colon-separated library list to search."},
+    CmdFlag{'s', "system-paths", "",
+            "Append the default search path after any given with -p."},
+    CmdFlag{'m', "min-version", "VERSION",
+            "Stop at the first driver supporting this CUDA version."},
+    CmdFlag{'d', "deadline-ms", "MS",
+            "Return the best result found so far after MS milliseconds."},
+    CmdFlag{'r', "ranked", "COUNT",
+            "Write up to COUNT ranked results in the loader library format."},
+    CmdFlag{'M', "materialize", "DIR",
+            "Link DIR to the selected driver, rebuilding it only if stale."},
+    CmdFlag{'c', "check", "DIR",
+            "Only check whether materialized DIR is current; no search."},
+    CmdFlag{'x', "metrics", "",
+            "Write the node's metrics for node_exporter and exit."},
     CmdFlag{'h', "help", "", "Display this help and exit."}};
 
 // Helper function for usage; determine the maximum formatted length for long
@@ -154,15 +173,23 @@ void add_path(const std::string_view src,
         return;
     }
 
-    if (!std::filesystem::exists(src_path)) {
+    const auto src_status = SEARCH_DEADLINE.run(src_path, [src_path]() {
+        std::error_code ec;
+        return std::filesystem::status(src_path, ec);
+    });
+    if (!src_status) {
+        return;
+    }
+
+    if (!std::filesystem::exists(*src_status)) {
         log_debug("skip {} (does not exist)", src_path);
         return;
     }
-    if (dir_mode && !std::filesystem::is_directory(src_path)) {
+    if (dir_mode && !std::filesystem::is_directory(*src_status)) {
         log_debug("skip {} (not a directory)", src_path);
         return;
     }
-    if (!dir_mode && !std::filesystem::is_regular_file(src_path)) {
+    if (!dir_mode && !std::filesystem::is_regular_file(*src_status)) {
         log_debug("skip {} (not a regular file)", src_path);
         return;
     }
@@ -171,28 +198,83 @@ void add_path(const std::string_view src,
     out.push_back(src_path);
 }
 
-void parse_paths(const std::string_view src,
-                 std::vector<std::filesystem::path> &dst,
-                 std::unordered_set<std::filesystem::path> &cache,
-                 bool dir_mode) {
-    if (src.empty()) {
-        return;
+// Split colon-separated lists into their entries
+std::vector<std::string_view>
+split_paths(const std::vector<std::string> &lists) {
+    std::vector<std::string_view> entries;
+    for (const std::string_view src : lists) {
+        if (src.empty()) {
+            continue;
+        }
+        size_t cur = 0;
+        size_t next = std::string_view::npos;
+        while ((next = src.find(':', cur)) != std::string_view::npos) {
+            entries.push_back(src.substr(cur, next - cur));
+            cur = next + 1;
+        }
+        entries.push_back(src.substr(cur));
     }
-    dst.reserve(dst.size() + std::ranges::count(src, ':') + 1);
+    return entries;
+}
 
-    size_t cur = 0;
-    size_t next = std::string_view::npos;
-    while ((next = src.find(':', cur)) != std::string_view::npos) {
-        add_path(src.substr(cur, next - cur), dst, cache, dir_mode);
-        cur = next + 1;
+// Check and add entries, with any that were abandoned at the deadline by a
+// previous run moved to the end.  Excluded entries are dropped before they're
+// ever accessed.
+void add_paths(const std::vector<std::string_view> &entries,
+               const std::unordered_set<std::filesystem::path> &slow_paths,
+               std::vector<std::filesystem::path> &dst, bool dir_mode) {
+    std::unordered_set<std::filesystem::path> cache;
+    std::vector<std::string_view> deferred;
+    dst.reserve(dst.size() + entries.size());
+    for (const auto entry : entries) {
+        if (is_excluded(entry)) {
+            log_verbose("{} (excluded by admin configuration)", entry);
+            continue;
+        }
+        if (slow_paths.contains(entry)) {
+            deferred.push_back(entry);
+            continue;
+        }
+        add_path(entry, dst, cache, dir_mode);
+    }
+    for (const auto entry : deferred) {
+        log_verbose("{} (trying last; slow in a previous run)", entry);
+        add_path(entry, dst, cache, dir_mode);
     }
-    add_path(cur == 0 ? src : src.substr(cur), dst, cache, dir_mode);
+}
+
+// Parse a CUDA version as either the cuDriverGetVersion encoding, i.e. 12040,
+// or as MAJOR.MINOR, i.e. 12.4
+bool parse_version(const std::string_view src, int &out) {
+    int major = 0;
+    const char *const end = src.data() + src.size();
+    auto [ptr, ec] = std::from_chars(src.data(), end, major);
+    if (ec != std::errc{} || major < 0) {
+        return false;
+    }
+    if (ptr == end) {
+        out = major;
+        return true;
+    }
+
+    int minor = 0;
+    if (*ptr != '.') {
+        return false;
+    }
+    const auto minor_result = std::from_chars(ptr + 1, end, minor);
+    if (minor_result.ec != std::errc{} || minor_result.ptr != end ||
+        // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        minor < 0 || minor > 99) {
+        return false;
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    out = (major * 1000) + (minor * 10);
+    return true;
 }
 
 // Get the default search path from the dynamic linker for when the arguments
 // don't specify one.
-bool get_default_search_path(std::vector<std::filesystem::path> &out,
-                             std::unordered_set<std::filesystem::path> &cache) {
+bool get_default_search_path(std::vector<std::string> &out) {
     void *handle = dlopen(nullptr, RTLD_LAZY | RTLD_LOCAL);
     if (handle == nullptr) {
         log_trace("{}", dlerror());
@@ -229,36 +311,91 @@ bool get_default_search_path(std::vector<std::filesystem::path> &out,
     const std::span<Dl_serpath> dls_serpath{
         static_cast<Dl_serpath *>(serinfo->dls_serpath), serinfo->dls_cnt};
     for (const auto &serpath : dls_serpath) {
-        add_path(serpath.dls_name, out, cache, true);
+        out.emplace_back(serpath.dls_name);
     }
 
     return true;
 }
 
+// Read arguments from stdin.  The loader libraries send NUL-terminated
+// arguments ending with an empty one so paths can contain any character but
+// a single whitespace-separated line is also accepted for interactive use.
 std::vector<std::string> parse_argv_from_stdin(void) {
-    std::string line;
-    if (!std::getline(std::cin, line)) {
+    std::vector<std::string> args;
+
+    std::string arg;
+    if (!std::getline(std::cin, arg, '\0')) {
         log_error("Failed to read arguments from stdin");
         return {};
     }
-    log_debug("{}", line);
 
-    std::vector<std::string> args;
-    std::istringstream iss(line);
-    for (std::string arg; iss >> arg;) {
+    if (std::cin.eof()) {
+        log_debug("{}", arg);
+        std::istringstream iss(arg.substr(0, arg.find('\n')));
+        for (std::string token; iss >> token;) {
+            log_trace("{}", token);
+            args.push_back(token);
+        }
+        return args;
+    }
+
+    while (!arg.empty()) {
         log_trace("{}", arg);
         args.push_back(arg);
+        if (!std::getline(std::cin, arg, '\0')) {
+            log_error("Unterminated arguments from stdin");
+            return {};
+        }
     }
 
     return args;
 }
 
+// The option selecting a mode, for error messages
+constexpr std::string_view get_mode_option(SearchMode mode) {
+    switch (mode) {
+    case SearchMode::materialize:
+        return "--materialize";
+    case SearchMode::check:
+        return "--check";
+    case SearchMode::metrics:
+        return "--metrics";
+    case SearchMode::search:
+        break;
+    }
+    return "";
+}
+
+// Select a mode, which fails if a different one was already selected
+bool set_mode(const char *exe, SearchMode mode, SearchOptions &options) {
+    if (options.mode != SearchMode::search && options.mode != mode) {
+        log_error("{}: option '{}' can't be combined with '{}'", exe,
+                  get_mode_option(mode), get_mode_option(options.mode));
+        return false;
+    }
+    options.mode = mode;
+    return true;
+}
+
+// Select a mode operating on a materialized directory
+bool set_materialize_mode(const char *exe, SearchMode mode, const char *dir,
+                          SearchOptions &options) {
+    if (*dir == '\0') {
+        log_error("{}: invalid directory '{}'", exe, dir);
+        return false;
+    }
+    if (!set_mode(exe, mode, options)) {
+        return false;
+    }
+    options.materialize_dir = dir;
+    return true;
+}
+
 bool parse_args_helper(std::span<char *> argv,
-                       std::vector<std::filesystem::path> &paths,
-                       std::unordered_set<std::filesystem::path> &path_cache,
-                       std::vector<std::filesystem::path> &libs,
-                       std::unordered_set<std::filesystem::path> &lib_cache,
-                       bool &arg_search_path_seen) {
+                       std::vector<std::string> &path_lists,
+                       std::vector<std::string> &lib_lists,
+                       bool &arg_search_path_seen,
+                       bool &arg_system_paths_seen, SearchOptions &options) {
 
     static constexpr auto optstring = generate_shortopts();
     static constexpr auto longopts = generate_longopts();
@@ -275,12 +412,58 @@ bool parse_args_helper(std::span<char *> argv,
         switch (opt) {
         case 'p':
             arg_search_path_seen = true;
-            log_info("Adding search paths");
-            parse_paths(optarg, paths, path_cache, true);
+            path_lists.emplace_back(optarg);
             break;
         case 'l':
-            log_info("Adding search libs");
-            parse_paths(optarg, libs, lib_cache, false);
+            lib_lists.emplace_back(optarg);
+            break;
+        case 's':
+            arg_system_paths_seen = true;
+            break;
+        case 'm':
+            if (!parse_version(optarg, options.min_version)) {
+                log_error("{}: invalid version '{}'", argv[0], optarg);
+                return false;
+            }
+            log_info("Minimum required version: {}", options.min_version);
+            break;
+        case 'd': {
+            std::chrono::milliseconds budget{};
+            if (!parse_deadline_ms(optarg, budget)) {
+                log_error("{}: invalid deadline '{}'", argv[0], optarg);
+                return false;
+            }
+            SEARCH_DEADLINE.set_budget(budget);
+            break;
+        }
+        case 'r': {
+            const std::string_view value(optarg);
+            const auto [ptr, ec] =
+                std::from_chars(value.data(), value.data() + value.size(),
+                                options.num_ranked);
+            if (ec != std::errc{} || ptr != value.data() + value.size() ||
+                options.num_ranked <= 0) {
+                log_error("{}: invalid result count '{}'", argv[0], optarg);
+                return false;
+            }
+            break;
+        }
+        case 'M':
+            if (!set_materialize_mode(argv[0], SearchMode::materialize,
+                                      optarg, options)) {
+                return false;
+            }
+            break;
+        case 'c':
+            if (!set_materialize_mode(argv[0], SearchMode::check, optarg,
+                                      options)) {
+                return false;
+            }
+            break;
+        case 'x':
+            if (!set_mode(argv[0], SearchMode::metrics, options)) {
+                return false;
+            }
             break;
         case 'h':
             usage(argv[0]);
@@ -317,8 +500,9 @@ bool parse_args_helper(std::span<char *> argv,
             std::ranges::transform(new_args, std::back_inserter(new_argv),
                                    [](std::string &str) { return str.data(); });
 
-            if (!parse_args_helper(new_argv, paths, path_cache, libs, lib_cache,
-                                   arg_search_path_seen)) {
+            if (!parse_args_helper(new_argv, path_lists, lib_lists,
+                                   arg_search_path_seen,
+                                   arg_system_paths_seen, options)) {
                 return false;
             }
         }
@@ -329,26 +513,49 @@ bool parse_args_helper(std::span<char *> argv,
 
 } // end anonymous namespace
 
-bool parse_args(std::span<char *> argv,
-                std::vector<std::filesystem::path> &paths,
-                std::vector<std::filesystem::path> &libs) {
+bool parse_args(std::span<char *> argv, SearchOptions &options,
+                const std::unordered_set<std::filesystem::path> &slow_paths) {
     bool arg_search_path_seen = false;
-    std::unordered_set<std::filesystem::path> path_cache;
-    std::unordered_set<std::filesystem::path> lib_cache;
-
-    if (!parse_args_helper(argv, paths, path_cache, libs, lib_cache,
-                           arg_search_path_seen)) {
+    bool arg_system_paths_seen = false;
+    std::vector<std::string> path_lists;
+    std::vector<std::string> lib_lists;
+
+    // Paths are only checked once all of the arguments are parsed so the
+    // deadline applies to them no matter where it appears
+    if (!parse_args_helper(argv, path_lists, lib_lists, arg_search_path_seen,
+                           arg_system_paths_seen, options)) {
         return false;
     }
+    // Ranked results are only written by a plain search
+    if (options.num_ranked > 0 && options.mode != SearchMode::search) {
+        log_error("{}: option '--ranked' can't be combined with '{}'",
+                  argv[0], get_mode_option(options.mode));
+        return false;
+    }
+    if (options.mode == SearchMode::check ||
+        options.mode == SearchMode::metrics) {
+        return true;
+    }
 
-    if (!arg_search_path_seen) {
+    // The default search path is always used if no explicit paths were given
+    // but can also be appended after them, i.e. when the caller passes the
+    // application's own DT_RPATH, LD_LIBRARY_PATH, and DT_RUNPATH
+    if (!arg_search_path_seen || arg_system_paths_seen) {
         log_info("Adding default search paths");
-        if (!get_default_search_path(paths, path_cache)) {
-            log_error("failed to get default search path.");
-            return false;
+        if (!get_default_search_path(path_lists)) {
+            if (!arg_search_path_seen) {
+                log_error("failed to get default search path.");
+                return false;
+            }
+            log_warn("failed to get default search path.");
         }
     }
 
+    log_info("Adding search paths");
+    add_paths(split_paths(path_lists), slow_paths, options.search_paths, true);
+    log_info("Adding search libs");
+    add_paths(split_paths(lib_lists), slow_paths, options.search_libs, false);
+
     return true;
 }
 
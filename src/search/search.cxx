@@ -16,70 +16,190 @@
 #include "search.h"
 
 #include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <charconv>
+#include <chrono>
 #include <functional>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
 #include <utility>
+#include <vector>
 
+#include "deadline.h"
 #include "dl_library.h"
+#include "driver_versions.h"
+#include "fingerprint.h"
 #include "logging.h"
+#include "stage.h"
 
 namespace autocompat {
 
 namespace {
 
-int get_libcuda_api_ver(const std::filesystem::path &libcuda_path,
-                        SearchState &state) {
-    struct stat libcuda_stat{};
+// stat a path under the search deadline, which is charged to subject
+std::optional<struct stat> stat_path(const std::filesystem::path &path,
+                                     const std::filesystem::path &subject) {
+    log_trace("stat({})", path);
+    return SEARCH_DEADLINE
+        .run(subject,
+             [path]() -> std::optional<struct stat> {
+                 struct stat path_stat{};
+                 if (::stat(path.c_str(), &path_stat) != 0) {
+                     log_trace("{}", std::strerror(errno));
+                     return std::nullopt;
+                 }
+                 return path_stat;
+             })
+        .value_or(std::nullopt);
+}
 
-    log_trace("stat({})", libcuda_path);
-    if (::stat(libcuda_path.c_str(), &libcuda_stat) != 0) {
-        log_trace("{}", std::strerror(errno));
-        return -3;
-    }
-    if (S_ISDIR(libcuda_stat.st_mode)) {
-        return -4;
-    }
+// cachestat(2) from Linux 6.5, which the C library and older kernel headers
+// don't have; its number is the same on every architecture
+#ifndef __NR_cachestat
+#define __NR_cachestat 451
+#endif
 
-    auto cache_entry = state.ver_cache.emplace(libcuda_stat.st_ino, -1);
-    if (!cache_entry.second) {
-        log_debug("cached (inode = {})", libcuda_stat.st_ino);
-        return cache_entry.first->second;
-    }
+struct CacheStatRange {
+    uint64_t off;
+    uint64_t len;
+};
 
-    const DlLibrary libcuda{libcuda_path};
-    if (!libcuda) {
-        return -1;
+struct CacheStat {
+    uint64_t nr_cache;
+    uint64_t nr_dirty;
+    uint64_t nr_writeback;
+    uint64_t nr_evicted;
+    uint64_t nr_recently_evicted;
+};
+
+// Fraction of an open file's pages in the page cache from cachestat, which
+// unlike mincore needs no mapping and, before Linux 6.14, no write access
+std::optional<double> get_cached_fraction(int fd, size_t len,
+                                          size_t page_size) {
+    // A zero length covers the whole file
+    CacheStatRange range{0, 0};
+    CacheStat cached{};
+    if (::syscall(__NR_cachestat, fd, &range, &cached, 0) != 0) {
+        return std::nullopt;
     }
+    const auto pages = (len + page_size - 1) / page_size;
+    return std::min(static_cast<double>(cached.nr_cache) /
+                        static_cast<double>(pages),
+                    1.0);
+}
 
-    if (libcuda.get_data_symbol<int>("cuda_autocompat_version") != nullptr) {
-        return -2;
+// Fraction of an open file's pages in the page cache from mincore, which
+// only reports the page cache for files the caller owns or could write to
+// and otherwise just the pages it mapped itself
+std::optional<double> get_mapped_resident_fraction(int fd, size_t len,
+                                                   size_t page_size) {
+    void *addr = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return std::nullopt;
     }
+    std::optional<double> fraction;
+    std::vector<unsigned char> pages((len + page_size - 1) / page_size);
+    if (::mincore(addr, len, pages.data()) == 0) {
+        const auto resident =
+            std::ranges::count_if(pages, [](unsigned char page) {
+                return (page & 1U) != 0;
+            });
+        fraction =
+            static_cast<double>(resident) / static_cast<double>(pages.size());
+    }
+    (void)::munmap(addr, len);
+    return fraction;
+}
 
-    auto cuGetErrorName =
-        libcuda.get_function_symbol<int, int, const char *&>("cuGetErrorName");
-    if (!cuGetErrorName) {
-        return -1;
+// Get the fraction of a file's pages in the page cache without faulting any
+// in, with cachestat where the kernel allows it.  Since Linux 6.14 it's
+// subject to the same check as mincore, so there, or before 6.5, the
+// fraction is only known for files the user owns or can write to, or any
+// file as root.
+std::optional<double>
+get_resident_fraction(const std::filesystem::path &path) {
+    const auto file_stat = stat_path(path, path.parent_path());
+    if (!file_stat || file_stat->st_size <= 0) {
+        return std::nullopt;
     }
+    const auto len = static_cast<size_t>(file_stat->st_size);
+    const bool may_mincore = ::geteuid() == 0 ||
+                             file_stat->st_uid == ::geteuid();
+    return SEARCH_DEADLINE
+        .run(path,
+             [path, len, may_mincore]() -> std::optional<double> {
+                 const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                 if (fd < 0) {
+                     return std::nullopt;
+                 }
+                 const auto page_size =
+                     static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                 auto fraction = get_cached_fraction(fd, len, page_size);
+                 if (!fraction &&
+                     (may_mincore || ::faccessat(AT_FDCWD, path.c_str(), W_OK,
+                                                 AT_EACCESS) == 0)) {
+                     fraction =
+                         get_mapped_resident_fraction(fd, len, page_size);
+                 }
+                 (void)::close(fd);
+                 return fraction;
+             })
+        .value_or(std::nullopt);
+}
 
-    auto cuGetErrorString =
-        libcuda.get_function_symbol<int, int, const char *&>(
-            "cuGetErrorString");
-    if (!cuGetErrorString) {
+// Whether a has more of its libcuda.so.1 in the page cache than b
+bool is_more_resident(const std::optional<double> &a,
+                      const std::optional<double> &b) {
+    return a && b && *a > *b;
+}
+
+// Probed libraries are kept loaded until the helper exits, rather than
+// unloaded after each probe, and never destroyed since an abandoned probe may
+// still be running in one of them
+DlLibraryCache &probe_libraries(void) {
+    static auto *libraries = new DlLibraryCache;
+    return *libraries;
+}
+
+int probe_libcuda_api_ver(const std::filesystem::path &libcuda_path) {
+    const DlLibrary *libcuda = probe_libraries().open(libcuda_path);
+    if (!libcuda || !*libcuda) {
         return -1;
     }
 
-    auto cuDriverGetVersion =
-        libcuda.get_function_symbol<int, int &>("cuDriverGetVersion");
-    if (!cuDriverGetVersion) {
+    const int *cuda_autocompat_version = nullptr;
+    int (*cuGetErrorName)(int, const char *&) = nullptr;
+    int (*cuGetErrorString)(int, const char *&) = nullptr;
+    int (*cuDriverGetVersion)(int &) = nullptr;
+    (void)libcuda->get_symbols({"cuda_autocompat_version", "cuGetErrorName",
+                                "cuGetErrorString", "cuDriverGetVersion"},
+                               cuda_autocompat_version, cuGetErrorName,
+                               cuGetErrorString, cuDriverGetVersion);
+    if (cuda_autocompat_version != nullptr) {
+        return -2;
+    }
+    if (!cuGetErrorName || !cuGetErrorString || !cuDriverGetVersion) {
         return -1;
     }
 
-    int &ver = cache_entry.first->second;
+    int ver = -1;
     int ret = cuDriverGetVersion(ver);
     if (ret != 0) {
         const char *err_name = nullptr;
@@ -95,13 +215,133 @@ int get_libcuda_api_ver(const std::filesystem::path &libcuda_path,
     return ver;
 }
 
+uint64_t get_stat_fingerprint(const struct stat &file_stat) {
+    return autocompat_fingerprint(file_stat.st_dev, file_stat.st_ino,
+                                  file_stat.st_size, file_stat.st_mtim.tv_sec,
+                                  file_stat.st_mtim.tv_nsec);
+}
+
+uint64_t get_libcuda_fingerprint(const std::filesystem::path &libcuda_path) {
+    const auto libcuda_stat =
+        stat_path(libcuda_path, libcuda_path.parent_path());
+    return libcuda_stat ? get_stat_fingerprint(*libcuda_stat) : 0;
+}
+
+int get_libcuda_api_ver(const std::filesystem::path &libcuda_path,
+                        SearchState &state, uint64_t &fingerprint) {
+    const auto libcuda_dir = libcuda_path.parent_path();
+    const auto libcuda_stat = stat_path(libcuda_path, libcuda_dir);
+    if (!libcuda_stat) {
+        return -3;
+    }
+    if (S_ISDIR(libcuda_stat->st_mode)) {
+        return -4;
+    }
+    fingerprint = get_stat_fingerprint(*libcuda_stat);
+
+    auto cache_entry = state.ver_cache.emplace(libcuda_stat->st_ino, -1);
+    if (!cache_entry.second) {
+        log_debug("cached (inode = {})", libcuda_stat->st_ino);
+        return cache_entry.first->second;
+    }
+
+    // A copy already staged from this same file is probed instead so the
+    // original isn't read from a shared filesystem again
+    const auto probe_path =
+        find_staged_libcuda(libcuda_path, fingerprint).value_or(libcuda_path);
+    if (probe_path != libcuda_path) {
+        log_info("libcuda: Probing staged copy {}", probe_path);
+    }
+    const auto api_ver = SEARCH_DEADLINE.run(
+        libcuda_dir,
+        [probe_path]() { return probe_libcuda_api_ver(probe_path); });
+    if (api_ver) {
+        state.probed_dirs.insert(libcuda_dir);
+    }
+    cache_entry.first->second = api_ver.value_or(-5);
+    return cache_entry.first->second;
+}
+
+int get_libcudart_runtime_ver(const std::filesystem::path &libcudart_path) {
+    const DlLibrary *libcudart = probe_libraries().open(libcudart_path);
+    if (!libcudart || !*libcudart) {
+        return -1;
+    }
+
+    auto cudaRuntimeGetVersion =
+        libcudart->get_function_symbol<int, int &>("cudaRuntimeGetVersion");
+    if (!cudaRuntimeGetVersion) {
+        return -1;
+    }
+
+    int ver = -1;
+    int ret = cudaRuntimeGetVersion(ver);
+    if (ret != 0) {
+        log_trace("cudaRuntimeGetVersion: {}", ret);
+        return -1;
+    }
+    return ver;
+}
+
+inline bool is_libcudart_soname(const std::filesystem::path &fname) {
+    return fname == "libcudart.so.11" || fname == "libcudart.so.12" ||
+           fname == "libcudart.so.13";
+}
+
 inline bool check_file_exists(const std::filesystem::path &file_path) {
-    auto file_stat = std::filesystem::status(file_path);
-    return std::filesystem::exists(file_stat) &&
-           std::filesystem::is_regular_file(file_stat);
+    return SEARCH_DEADLINE
+        .run(file_path.parent_path(),
+             [file_path]() {
+                 std::error_code ec;
+                 const auto file_stat = std::filesystem::status(file_path, ec);
+                 return std::filesystem::exists(file_stat) &&
+                        std::filesystem::is_regular_file(file_stat);
+             })
+        .value_or(false);
 }
 
-int update_libcuda(const std::filesystem::path &libcuda_path,
+// List the names in a directory whose entries of interest aren't known up
+// front, which is a single pass of getdents for all but huge directories
+inline std::optional<std::vector<std::string>>
+list_directory(const std::filesystem::path &dir_path) {
+    log_trace("opendir({})", dir_path);
+    return SEARCH_DEADLINE
+        .run(dir_path,
+             [dir_path]() -> std::optional<std::vector<std::string>> {
+                 std::error_code ec;
+                 std::filesystem::directory_iterator dir(dir_path, ec);
+                 if (ec) {
+                     log_trace("{}", ec.message());
+                     return std::nullopt;
+                 }
+                 std::vector<std::string> names;
+                 for (; dir != std::filesystem::directory_iterator{};
+                      dir.increment(ec)) {
+                     names.push_back(dir->path().filename().native());
+                 }
+                 return names;
+             })
+        .value_or(std::nullopt);
+}
+
+// When the same directory is reached through more than one path keep the
+// one earliest in the search order, regardless of which was probed first
+void update_duplicate_dir(const std::filesystem::path &libcuda_dir,
+                          ino_t dir_inode, size_t order, SearchState &state) {
+    for (auto &result : state.validated) {
+        if (result.dir_inode == dir_inode && order < result.order) {
+            log_debug("earlier in search order than {}", result.driver_dir);
+            if (state.found && state.found->dir_inode == dir_inode) {
+                state.found->driver_dir = libcuda_dir;
+                state.found->order = order;
+            }
+            result.driver_dir = libcuda_dir;
+            result.order = order;
+        }
+    }
+}
+
+int update_libcuda(const std::filesystem::path &libcuda_path, size_t order,
                    SearchState &state) {
     log_info("libcuda: {}", libcuda_path);
 
@@ -111,25 +351,46 @@ int update_libcuda(const std::filesystem::path &libcuda_path,
         return -1;
     }
 
-    struct stat libcuda_dir_stat{};
-    log_trace("stat({})", libcuda_dir);
-    if (::stat(libcuda_dir.c_str(), &libcuda_dir_stat) != 0) {
-        log_trace("{}", std::strerror(errno));
+    const auto libcuda_dir_stat = stat_path(libcuda_dir, libcuda_dir);
+    if (!libcuda_dir_stat) {
         log_info("libcuda: Skipping (directory stat error)");
         return -1;
     }
-    if (!S_ISDIR(libcuda_dir_stat.st_mode)) {
+    if (!S_ISDIR(libcuda_dir_stat->st_mode)) {
         log_info("libcuda: Skipping (directory error)");
         return -1;
     }
-    if (!state.dir_inode_cache.insert(libcuda_dir_stat.st_ino).second) {
-        log_debug("cached (inode = {})", libcuda_dir_stat.st_ino);
+    if (!state.dir_inode_cache.insert(libcuda_dir_stat->st_ino).second) {
+        log_debug("cached (inode = {})", libcuda_dir_stat->st_ino);
         log_info("libcuda: Skipping (directory inode already checked)");
+        update_duplicate_dir(libcuda_dir, libcuda_dir_stat->st_ino, order,
+                             state);
         return -1;
     }
-    
-    int ver = get_libcuda_api_ver(libcuda_path, state);
+
+    // Measured before the probe loads the library itself
+    const auto resident = get_resident_fraction(libcuda_path);
+    if (resident) {
+        log_debug("{}% resident in page cache",
+                  static_cast<int>(*resident * 100));
+    }
+
+    uint64_t fingerprint = 0;
+    const auto probe_start = std::chrono::steady_clock::now();
+    int ver = get_libcuda_api_ver(libcuda_path, state, fingerprint);
+    const auto probe_time =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - probe_start);
+    // Abandoned probes say nothing about the library itself so they're left
+    // to the slow paths list instead
+    const auto record_probe = [&](int version) {
+        state.history.record_probe(libcuda_path, fingerprint, version,
+                                   probe_time);
+    };
     switch (ver) {
+    case -5:
+        log_info("libcuda: Skipping (deadline expired)");
+        return -1;
     case -4:
         log_info("libcuda: Skipping (directory)");
         return -1;
@@ -138,9 +399,11 @@ int update_libcuda(const std::filesystem::path &libcuda_path,
         return -1;
     case -2:
         log_info("libcuda: Skipping (autocompat detected)");
+        record_probe(-1);
         return -1;
     case -1:
         log_info("libcuda: Skipping (library error)");
+        record_probe(-1);
         return -1;
     default:
         break;
@@ -148,34 +411,58 @@ int update_libcuda(const std::filesystem::path &libcuda_path,
 
     if (!check_file_exists(libcuda_dir / "libnvidia-nvvm.so.4")) {
         log_info("libcuda: Skipping (libnvidia-nvvm.so.4 not found)");
+        record_probe(-1);
         return -1;
     }
     if (!check_file_exists(libcuda_dir / "libnvidia-ptxjitcompiler.so.1")) {
         log_info("libcuda: Skipping (libnvidia-nvvm.so.4 not found)");
+        record_probe(-1);
         return -1;
     }
     if (!check_file_exists(libcuda_dir / "libcudadebugger.so.1")) {
         log_info("libcuda: Skipping (libcudadebugger.so.1 not found)");
+        record_probe(-1);
         return -1;
     }
 
     log_info("libcuda: cuDriverGetVersion = {}", ver);
+    record_probe(ver);
+
+    const SearchResult result{ver, libcuda_dir, fingerprint, order,
+                              libcuda_dir_stat->st_ino, resident};
+    state.validated.push_back(result);
 
     if (!state.found) {
         log_info("libcuda: Updating (first found)");
-        state.found = {ver, libcuda_dir};
-        return 0;
-    }
-
-    if (ver > state.found->version) {
+        state.found = result;
+    } else if (state.meets_minimum()) {
+        // The goal-directed search keeps the first driver that's new enough
+        // and only carries on for the fallbacks
+        log_info("libcuda: Keeping as fallback (minimum already satisfied)");
+        return 1;
+    } else if (ver > state.found->version) {
         log_info("libcuda: Updating ({} > {})", ver, state.found->version);
-        state.found = {ver, libcuda_dir};
-        return 0;
+        state.found = result;
+    } else if (ver == state.found->version &&
+               is_more_resident(resident, state.found->resident)) {
+        log_info("libcuda: Updating ({} == {}, more resident in page cache)",
+                 ver, state.found->version);
+        state.found = result;
+    } else if (ver == state.found->version && order < state.found->order &&
+               !is_more_resident(state.found->resident, resident)) {
+        log_info("libcuda: Updating ({} == {}, earlier in search order)", ver,
+                 state.found->version);
+        state.found = result;
+    } else {
+        log_info("libcuda: Skipping ({} <= {})", ver, state.found->version);
+        return 1;
     }
 
-    log_info("libcuda: Skipping ({} <= {})", ver, state.found->version);
-
-    return 1;
+    if (state.meets_minimum()) {
+        log_info("libcuda: Minimum version satisfied ({} >= {})", ver,
+                 state.min_version);
+    }
+    return 0;
 }
 
 inline std::optional<std::filesystem::path>
@@ -193,26 +480,299 @@ check_path_ends_with(std::filesystem::path full, std::filesystem::path suffix) {
     return full;
 }
 
-inline std::optional<std::filesystem::path>
-get_toolkit_from_libcudart(const std::filesystem::path &lib_path) {
-    const auto &reallib_dir =
-        std::filesystem::weakly_canonical(lib_path).parent_path();
+// Parse the MAJOR.MINOR[.PATCH] version suffix from a real library file name,
+// i.e. libcudart.so.12.4.127 or libcuda.so.550.54.15
+inline std::optional<std::array<int, 3>>
+parse_so_version(const std::filesystem::path &real_path,
+                 const std::string_view prefix) {
+    const auto fname = real_path.filename().native();
+    if (!std::string_view(fname).starts_with(prefix)) {
+        return std::nullopt;
+    }
+
+    std::array<int, 3> ver{};
+    const char *cursor = fname.data() + prefix.size();
+    const char *const end = fname.data() + fname.size();
+    for (size_t i = 0; i < ver.size() && cursor < end; ++i) {
+        auto [ptr, ec] = std::from_chars(cursor, end, ver.at(i));
+        if (ec != std::errc{} || (ptr != end && *ptr != '.')) {
+            return std::nullopt;
+        }
+        if (i == 0 && ptr == end) {
+            return std::nullopt; // Just the soname major version
+        }
+        cursor = ptr == end ? end : ptr + 1;
+    }
+    return ver;
+}
+
+// A driver's version as encoded in the real file name of its libcuda.so.1
+std::optional<DriverVersion>
+get_libcuda_so_version(const std::filesystem::path &libcuda_path) {
+    const auto real_path =
+        SEARCH_DEADLINE
+            .run(libcuda_path.parent_path(),
+                 [libcuda_path]() -> std::optional<std::filesystem::path> {
+                     std::error_code ec;
+                     auto path = std::filesystem::canonical(libcuda_path, ec);
+                     if (ec) {
+                         return std::nullopt;
+                     }
+                     return path;
+                 })
+            .value_or(std::nullopt);
+    if (!real_path) {
+        return std::nullopt;
+    }
+    return parse_so_version(*real_path, "libcuda.so.");
+}
+
+// A toolkit's compat driver supports exactly the toolkit's CUDA version, which
+// is encoded in the real file name of its libcudart.so.N
+int get_libcudart_version_bound(const std::filesystem::path &real_path) {
+    const auto ver = parse_so_version(real_path, "libcudart.so.");
+    if (!ver) {
+        return UNKNOWN_VERSION_BOUND;
+    }
+    // The final digit isn't used for MAJOR.MINOR so allow any value there to
+    // keep this a strict upper bound
+    // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    return (ver->at(0) * 1000) + (ver->at(1) * 10) + 9;
+}
+
+void add_candidate(const std::filesystem::path &libcuda_path, int bound,
+                   SearchState &state) {
+    if (is_excluded(libcuda_path.parent_path())) {
+        log_verbose("{} (excluded by admin configuration)", libcuda_path);
+        return;
+    }
+
+    // Cheap upper bound on the version from the driver's branch, which also
+    // rules out drivers the loaded kernel module would reject
+    const auto so_ver = get_libcuda_so_version(libcuda_path);
+    if (so_ver && state.kernel_module &&
+        !driver_runs_on_kernel_module(*so_ver, *state.kernel_module)) {
+        log_verbose("{} ({}.{}.{} incompatible with kernel module)",
+                    libcuda_path, so_ver->at(0), so_ver->at(1), so_ver->at(2));
+        ++state.num_pruned;
+        return;
+    }
+    if (so_ver) {
+        bound = std::min(bound, driver_branch_version_bound(so_ver->at(0))
+                                    .value_or(UNKNOWN_VERSION_BOUND));
+    }
+
+    // If a previous run probed the same file then its version is known
+    // exactly, which is the tightest possible bound
+    bool known_failure = false;
+    if (const auto *record = state.history.find(libcuda_path)) {
+        const auto fingerprint = get_libcuda_fingerprint(libcuda_path);
+        if (const auto known_ver =
+                state.history.known_version(libcuda_path, fingerprint)) {
+            log_debug("known version {} from history", *known_ver);
+            bound = std::min(bound, *known_ver);
+        } else if (fingerprint == record->fingerprint) {
+            log_debug("known failure from history");
+            known_failure = true;
+        }
+    }
+
+    if (bound == UNKNOWN_VERSION_BOUND) {
+        log_debug("candidate {} (no version bound)", libcuda_path);
+    } else {
+        log_debug("candidate {} (version bound {})", libcuda_path, bound);
+    }
+    state.candidates.push_back(
+        {libcuda_path, bound, state.next_order++, known_failure});
+}
+
+void add_toolkit_candidate(const std::filesystem::path &libcudart_path,
+                           SearchState &state, bool check_compat) {
+    const auto reallib_result =
+        SEARCH_DEADLINE
+            .run(libcudart_path,
+                 [libcudart_path]() -> std::optional<std::filesystem::path> {
+                     std::error_code ec;
+                     auto path =
+                         std::filesystem::weakly_canonical(libcudart_path, ec);
+                     if (ec) {
+                         return std::nullopt;
+                     }
+                     return path;
+                 })
+            .value_or(std::nullopt);
+    if (!reallib_result) {
+        return;
+    }
+    const auto &reallib = *reallib_result;
+    const auto &reallib_dir = reallib.parent_path();
     log_debug("-> {}", reallib_dir);
 
     constexpr auto toolkit_subdir = "targets/x86_64-linux/lib";
-    return check_path_ends_with(reallib_dir, toolkit_subdir);
+    const auto toolkit_dir = check_path_ends_with(reallib_dir, toolkit_subdir);
+    if (!toolkit_dir) {
+        return;
+    }
+    log_debug("-> {}", *toolkit_dir);
+
+    const auto libcuda_path = *toolkit_dir / "compat" / "libcuda.so.1";
+    if (check_compat && !check_file_exists(libcuda_path)) {
+        return;
+    }
+    add_candidate(libcuda_path, get_libcudart_version_bound(reallib), state);
+}
+
+// Upper bound on the version of a toolkit's compat driver from its directory
+// name, i.e. cuda-12.4 or, in an HPC SDK, 12.4.  Like the libcudart bound
+// any final digit is allowed, and any minor version if there's none.
+std::optional<int> parse_toolkit_dir_version(std::string_view name) {
+    if (name.starts_with("cuda-")) {
+        name.remove_prefix(std::string_view("cuda-").size());
+    }
+    const char *cursor = name.data();
+    const char *const end = name.data() + name.size();
+
+    int major = 0;
+    auto [major_end, major_ec] = std::from_chars(cursor, end, major);
+    if (major_ec != std::errc{} || major <= 0) {
+        return std::nullopt;
+    }
+    // NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    if (major_end == end) {
+        return (major * 1000) + 999;
+    }
+    int minor = 0;
+    if (*major_end != '.') {
+        return std::nullopt;
+    }
+    auto [minor_end, minor_ec] = std::from_chars(major_end + 1, end, minor);
+    if (minor_ec != std::errc{} || minor_end != end) {
+        return std::nullopt;
+    }
+    return (major * 1000) + (minor * 10) + 9;
+    // NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+// Toolkit install prefixes searched when the admin configuration doesn't
+// give any, under CUDA_AUTOCOMPAT_SYSROOT if set: /usr/local with its
+// cuda-12.4, cuda-12.6, ... and each HPC SDK release's cuda directory with
+// its 12.4, 12.6, ...
+constexpr auto default_toolkit_prefixes = std::to_array(
+    {"usr/local", "opt/nvidia/hpc_sdk/*/*/cuda"});
+
+std::filesystem::path get_sysroot() {
+    const char *env_value = secure_getenv("CUDA_AUTOCOMPAT_SYSROOT");
+    if (env_value != nullptr && env_value[0] != '\0') {
+        return env_value;
+    }
+    return "/";
+}
+
+// The directories a toolkit prefix, which may contain shell wildcards,
+// refers to
+std::vector<std::filesystem::path>
+expand_toolkit_prefix(const std::filesystem::path &pattern) {
+    if (pattern.native().find_first_of("*?[") == std::string::npos) {
+        return {pattern};
+    }
+    log_trace("glob({})", pattern);
+    return SEARCH_DEADLINE
+        .run(pattern,
+             [pattern]() {
+                 std::vector<std::filesystem::path> dirs;
+                 glob_t matches{};
+                 if (glob(pattern.c_str(), GLOB_ONLYDIR, nullptr, &matches) ==
+                     0) {
+                     for (const char *match :
+                          std::span(matches.gl_pathv, matches.gl_pathc)) {
+                         dirs.emplace_back(match);
+                     }
+                 }
+                 globfree(&matches);
+                 return dirs;
+             })
+        .value_or(std::vector<std::filesystem::path>{});
 }
 
 } // end anonymous namespace
 
+bool is_excluded(const std::filesystem::path &path) {
+    const auto &native = path.native();
+    return admin_config_excludes(&ADMIN_CONFIG, native.data(),
+                                 static_cast<int>(native.size()));
+}
+
+void search_pinned_driver(SearchState &state) {
+    if (ADMIN_CONFIG.pin.len == 0) {
+        return;
+    }
+    const std::filesystem::path pin_dir(
+        std::string_view(ADMIN_CONFIG.pin.str, ADMIN_CONFIG.pin.len));
+    log_info("Checking pinned driver {}", pin_dir);
+
+    std::array<char, PATH_MAX> libcuda_path{};
+    uint64_t fingerprint = 0;
+    if (!admin_config_check_pin(&ADMIN_CONFIG, libcuda_path.data(),
+                                &fingerprint)) {
+        log_warn("Pinned driver {} not found or stale; searching", pin_dir);
+        return;
+    }
+
+    // The admin vouches for the driver so it isn't probed, which also means
+    // its version is unknown
+    log_info("libcuda: Using pinned driver");
+    state.found = SearchResult{0, pin_dir, fingerprint};
+    state.validated.push_back(*state.found);
+}
+
+void search_priority_paths(SearchState &state) {
+    if (ADMIN_CONFIG.num_priority == 0) {
+        return;
+    }
+    log_info("Searching priority paths");
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::span(ADMIN_CONFIG.priority,
+                                       ADMIN_CONFIG.num_priority)) {
+        paths.emplace_back(std::string_view(entry.str, entry.len));
+    }
+    search_paths_libcuda(paths, state);
+    probe_candidates(state);
+}
+
+void find_required_version(const std::vector<std::filesystem::path> &libs,
+                           SearchState &state) {
+    log_info("Checking required version from loaded runtime");
+    for (const auto &libcudart_path : libs) {
+        if (!is_libcudart_soname(libcudart_path.filename())) {
+            continue;
+        }
+        log_verbose("{}", libcudart_path);
+        const int ver =
+            SEARCH_DEADLINE
+                .run(libcudart_path,
+                     [libcudart_path]() {
+                         return get_libcudart_runtime_ver(libcudart_path);
+                     })
+                .value_or(-1);
+        log_verbose("cudaRuntimeGetVersion = {}", ver);
+        if (ver > state.min_version) {
+            state.min_version = ver;
+        }
+    }
+}
+
 void search_libraries_libcuda(const std::vector<std::filesystem::path> &libs,
                            SearchState &state) {
+    // An already loaded driver is used as-is so it's probed immediately
+    // rather than queued as a candidate
     log_info("Searching for driver in libraries");
     for (const auto &lib_path : libs) {
         log_verbose("{}", lib_path);
-        if (lib_path.filename() == "libcuda.so.1" &&
-            update_libcuda(lib_path, state) >= 0) {
-            break;
+        if (lib_path.filename() == "libcuda.so.1") {
+            ++state.num_probed;
+            if (update_libcuda(lib_path, 0, state) >= 0) {
+                break;
+            }
         }
     }
 }
@@ -222,17 +782,8 @@ void search_libraries_libcudart(const std::vector<std::filesystem::path> &libs,
     log_info("Searching for toolkits in libraries");
     for (const auto &libcudart_path : libs) {
         log_verbose("{}", libcudart_path);
-        const auto libcudart_fname = libcudart_path.filename();
-        if (libcudart_fname == "libcudart.so.11" ||
-            libcudart_fname == "libcudart.so.12" ||
-            libcudart_fname == "libcudart.so.13") {
-            const auto toolkit_dir = get_toolkit_from_libcudart(libcudart_path);
-            if (!toolkit_dir) {
-                continue;
-            }
-            log_debug("-> {}", *toolkit_dir);
-            const auto libcuda_path = *toolkit_dir / "compat" / "libcuda.so.1";
-            (void)update_libcuda(libcuda_path, state);
+        if (is_libcudart_soname(libcudart_path.filename())) {
+            add_toolkit_candidate(libcudart_path, state, false);
         }
     }
 }
@@ -251,7 +802,7 @@ void search_cuda_home(SearchState &state) {
     if (!check_file_exists(libcuda_path)) {
         return;
     }
-    (void)update_libcuda(libcuda_path, state);
+    add_candidate(libcuda_path, UNKNOWN_VERSION_BOUND, state);
 }
 
 void search_paths_libcudart(const std::vector<std::filesystem::path> &paths,
@@ -267,17 +818,66 @@ void search_paths_libcudart(const std::vector<std::filesystem::path> &paths,
             if (!check_file_exists(libcudart_path)) {
                 continue;
             }
-            const auto toolkit_dir = get_toolkit_from_libcudart(libcudart_path);
-            if (!toolkit_dir) {
+            add_toolkit_candidate(libcudart_path, state, true);
+            break;
+        }
+    }
+}
+
+void search_toolkit_prefixes(SearchState &state) {
+    log_info("Searching for toolkits in install prefixes");
+
+    // The admin configuration's prefixes replace the defaults
+    std::vector<std::filesystem::path> patterns;
+    if (ADMIN_CONFIG.num_toolkit_prefix > 0) {
+        for (const auto &entry : std::span(ADMIN_CONFIG.toolkit_prefix,
+                                           ADMIN_CONFIG.num_toolkit_prefix)) {
+            patterns.emplace_back(std::string_view(entry.str, entry.len));
+        }
+    } else {
+        const auto sysroot = get_sysroot();
+        for (const auto &prefix : default_toolkit_prefixes) {
+            patterns.push_back(sysroot / prefix);
+        }
+    }
+
+    struct Toolkit {
+        int version_bound;
+        std::filesystem::path dir;
+    };
+    std::vector<Toolkit> toolkits;
+    for (const auto &pattern : patterns) {
+        for (const auto &prefix : expand_toolkit_prefix(pattern)) {
+            log_verbose("{}", prefix);
+            if (is_excluded(prefix)) {
+                log_verbose("{} (excluded by admin configuration)", prefix);
                 continue;
             }
-            log_debug("-> {}", *toolkit_dir);
-            const auto libcuda_path = *toolkit_dir / "compat" / "libcuda.so.1";
-            if (check_file_exists(libcuda_path)) {
-                (void)update_libcuda(libcuda_path, state);
+            for (const auto &name : list_directory(prefix).value_or(
+                     std::vector<std::string>{})) {
+                if (const auto bound = parse_toolkit_dir_version(name)) {
+                    toolkits.push_back({*bound, prefix / name});
+                }
             }
+        }
+    }
+    std::ranges::stable_sort(toolkits, std::ranges::greater{},
+                             &Toolkit::version_bound);
+
+    // Older toolkits can only be selected if every newer one fails, so only
+    // as many as the loaders could fall back to are queued
+    const size_t max_candidates = state.candidates.size() + state.num_wanted;
+    for (const auto &toolkit : toolkits) {
+        if (state.candidates.size() >= max_candidates) {
+            log_debug("enough toolkits found; skipping {} and older",
+                      toolkit.dir);
             break;
         }
+        const auto libcuda_path = toolkit.dir / "compat" / "libcuda.so.1";
+        log_debug("{}", libcuda_path);
+        if (check_file_exists(libcuda_path)) {
+            add_candidate(libcuda_path, toolkit.version_bound, state);
+        }
     }
 }
 
@@ -291,7 +891,178 @@ void search_paths_libcuda(const std::vector<std::filesystem::path> &paths,
         if (!check_file_exists(lib_path)) {
             continue;
         }
-        (void)update_libcuda(lib_path, state);
+        add_candidate(lib_path, UNKNOWN_VERSION_BOUND, state);
+    }
+}
+
+// The version a candidate has to be able to reach to be worth probing: the
+// selected driver's, or with fallbacks wanted the worst of the best
+// num_wanted validated so far; nullopt until there are that many
+std::optional<int> get_prune_version(const SearchState &state) {
+    if (!state.found) {
+        return std::nullopt;
+    }
+    if (state.num_wanted <= 1) {
+        return state.found->version;
+    }
+    if (state.validated.size() < state.num_wanted) {
+        return std::nullopt;
+    }
+    std::vector<int> versions;
+    versions.reserve(state.validated.size());
+    for (const auto &result : state.validated) {
+        versions.push_back(result.version);
+    }
+    const auto nth = versions.begin() +
+                     static_cast<std::ptrdiff_t>(state.num_wanted - 1);
+    std::ranges::nth_element(versions, nth, std::ranges::greater{});
+    return *nth;
+}
+
+// Whether probing candidate could change the selected driver, or the
+// fallbacks if any are wanted.  One that can at most tie the selected driver
+// is still probed if more of it is in the page cache, i.e. an identical copy
+// of the driver that other processes on the node are using.
+bool can_prune(const SearchCandidate &candidate, const SearchState &state) {
+    const auto prune_version = get_prune_version(state);
+    if (!prune_version || candidate.version_bound == UNKNOWN_VERSION_BOUND) {
+        return false;
+    }
+    if (state.num_wanted > 1) {
+        return candidate.version_bound < *prune_version;
+    }
+    if (candidate.version_bound < state.found->version) {
+        return true;
+    }
+    // Only measured when the selected driver's residency is known, since a
+    // tie can't be broken otherwise
+    return candidate.version_bound == state.found->version &&
+           candidate.order > state.found->order &&
+           (!state.found->resident ||
+            !is_more_resident(get_resident_fraction(candidate.libcuda_path),
+                              state.found->resident));
+}
+
+void probe_candidate_list(std::vector<SearchCandidate> &candidates,
+                          SearchState &state) {
+    const auto max_probes = static_cast<size_t>(ADMIN_CONFIG.max_probes);
+    for (const auto &candidate : candidates) {
+        if (state.satisfied()) {
+            break;
+        }
+        if (max_probes > 0 && state.num_probed >= max_probes) {
+            log_info("Probe limit {} reached", max_probes);
+            break;
+        }
+        if (can_prune(candidate, state)) {
+            // Only the selected driver itself can be tied, and not by one
+            // more resident in the page cache
+            const int prune_version = *get_prune_version(state);
+            log_info("libcuda: {}", candidate.libcuda_path);
+            log_info("libcuda: Pruning (bound {} {} {})",
+                     candidate.version_bound,
+                     candidate.version_bound < prune_version ? "<" : "==",
+                     prune_version);
+            ++state.num_pruned;
+            continue;
+        }
+        ++state.num_probed;
+        (void)update_libcuda(candidate.libcuda_path, candidate.order, state);
+    }
+}
+
+// Sort candidates so the ones most likely to be selected are probed first.
+// Unbounded candidates sort first since they always need to be probed and
+// their results may allow bounded ones to be pruned, except for those that
+// failed validation in a previous run.  Among equal bounds the history
+// prefers candidates that won before and are quick to probe.
+void sort_newest_first(std::vector<SearchCandidate> &candidates,
+                       const SearchState &state) {
+    const auto key = [&](const SearchCandidate &candidate) {
+        unsigned int wins = 0;
+        int64_t probe_time = 0;
+        if (const auto *record = state.history.find(candidate.libcuda_path)) {
+            wins = record->wins;
+            probe_time = record->probe_time.count();
+        }
+        return std::tuple{candidate.known_failure, -candidate.version_bound,
+                          -static_cast<int64_t>(wins), probe_time,
+                          candidate.order};
+    };
+    std::ranges::sort(candidates, std::less{}, key);
+}
+
+void partition_slow_paths(std::vector<SearchCandidate> &candidates,
+                          const SearchState &state) {
+    if (!state.slow_paths.empty()) {
+        std::ranges::stable_partition(
+            candidates, [&](const SearchCandidate &candidate) {
+                return !state.slow_paths.contains(
+                    candidate.libcuda_path.parent_path());
+            });
+    }
+}
+
+void probe_candidates(SearchState &state) {
+    log_info("Probing candidates");
+
+    // Looking for the first driver in search order that's new enough, so
+    // only candidates that can't be new enough are moved out of the way
+    std::vector<SearchCandidate> deferred;
+    if (state.min_version > 0) {
+        const auto [first, last] = std::ranges::stable_partition(
+            state.candidates, [&](const SearchCandidate &candidate) {
+                return candidate.version_bound >= state.min_version;
+            });
+        for (auto it = first; it != last; ++it) {
+            log_info("libcuda: {}", it->libcuda_path);
+            log_info("libcuda: Deferring (bound {} < {})", it->version_bound,
+                     state.min_version);
+        }
+        deferred.assign(first, last);
+        state.candidates.erase(first, last);
+    } else {
+        sort_newest_first(state.candidates, state);
+    }
+    partition_slow_paths(state.candidates, state);
+    probe_candidate_list(state.candidates, state);
+
+    // Nothing was new enough so fall back to the newest of the rest
+    if (!deferred.empty() && !state.satisfied()) {
+        sort_newest_first(deferred, state);
+        partition_slow_paths(deferred, state);
+        probe_candidate_list(deferred, state);
+    }
+    state.candidates.clear();
+
+    log_info("Probed {} candidates, pruned {}", state.num_probed,
+             state.num_pruned);
+}
+
+std::vector<SearchResult> rank_results(const SearchState &state,
+                                       size_t count) {
+    // Newest first with ties in search order, other than the found driver
+    // first since it may have won a tie on page cache residency
+    std::vector<SearchResult> ranked = state.validated;
+    std::ranges::sort(ranked, std::less{}, [](const SearchResult &result) {
+        return std::pair{-result.version, result.order};
+    });
+    if (state.found) {
+        std::ranges::stable_partition(ranked, [&](const SearchResult &result) {
+            return result.driver_dir == state.found->driver_dir;
+        });
+    }
+    if (ranked.size() > count) {
+        ranked.resize(count);
+    }
+    return ranked;
+}
+
+void record_history(SearchState &state) {
+    for (const auto &result : state.validated) {
+        const bool won =
+            state.found && state.found->driver_dir == result.driver_dir;
+        state.history.record_outcome(result.driver_dir / "libcuda.so.1", won);
     }
 }
 
@@ -18,26 +18,153 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <filesystem>
+#include <limits>
 #include <optional>
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
 
+#include "admin_config.h"
+#include "driver_versions.h"
+#include "history.h"
+
 namespace autocompat {
 
+// Settings from the admin configuration file; see admin_config.h
+inline admin_config ADMIN_CONFIG{};
+
+// Whether the admin configuration excludes path from the search
+bool is_excluded(const std::filesystem::path &path);
+
 struct SearchResult {
     int version;
     std::filesystem::path driver_dir;
+
+    // Identity of the libcuda.so.1 that was probed; see fingerprint.h
+    uint64_t fingerprint = 0;
+
+    // Position in the search order, which breaks ties between drivers with
+    // the same version no matter what order they were probed in
+    size_t order = 0;
+
+    ino_t dir_inode = 0;
+
+    // Fraction of libcuda.so.1's pages that were in the page cache before it
+    // was probed, which breaks ties ahead of the search order so the process
+    // shares the pages its neighbors already read; nullopt if unknown
+    std::optional<double> resident;
+};
+
+// Marker for candidates without a cheap upper bound on their version
+constexpr int UNKNOWN_VERSION_BOUND = std::numeric_limits<int>::max();
+
+struct SearchCandidate {
+    std::filesystem::path libcuda_path;
+
+    // Upper bound on the candidate's cuDriverGetVersion, determined without
+    // loading it, used to skip probes that can't beat the current best
+    int version_bound;
+
+    size_t order;
+
+    // Whether the same file failed validation in a previous run
+    bool known_failure;
+};
+
+// What the helper does once its arguments are parsed; each mode has its own
+// option and they can't be combined
+enum class SearchMode {
+    // Search and write the selected driver's directory, or with num_ranked
+    // the ranked results for the loader libraries
+    search,
+    // Search and link materialize_dir to the selected driver; --materialize
+    materialize,
+    // Only check whether materialize_dir is current, without searching;
+    // --check
+    check,
+    // Only write the node's metrics; --metrics
+    metrics,
+};
+
+// The helper's command line
+struct SearchOptions {
+    SearchMode mode = SearchMode::search;
+
+    std::vector<std::filesystem::path> search_paths;
+    std::vector<std::filesystem::path> search_libs;
+
+    // See SearchState::min_version
+    int min_version = 0;
+
+    // The number of ranked results to write; 0 to write just the selected
+    // driver's directory
+    int num_ranked = 0;
+
+    // The materialized directory to build or check
+    std::filesystem::path materialize_dir;
 };
 
 struct SearchState {
+    // Version of the loaded nvidia kernel module, if any; see kernel_module.h
+    std::optional<DriverVersion> kernel_module;
+
+    // Minimum driver version needed by the application; 0 means none is known
+    // and the search looks for the newest available driver instead
+    int min_version = 0;
+
+    // The number of validated drivers wanted: the best one plus fallbacks for
+    // the loader libraries if it fails to load
+    size_t num_wanted = 1;
+
     std::optional<SearchResult> found;
+
+    // Every driver that passed validation, in the order probed, to give the
+    // loader libraries alternatives if the best one fails to load
+    std::vector<SearchResult> validated;
+    std::vector<SearchCandidate> candidates;
+    size_t next_order = 0;
+    size_t num_probed = 0;
+    size_t num_pruned = 0;
+    // Directories abandoned at the deadline by a previous run, probed last
+    std::unordered_set<std::filesystem::path> slow_paths;
+    // Directories whose driver was probed within the deadline
+    std::unordered_set<std::filesystem::path> probed_dirs;
+
+    ProbeHistory history;
+
     std::unordered_set<std::filesystem::path> dir_path_cache;
     std::unordered_set<ino_t> dir_inode_cache;
     std::unordered_map<ino_t, int> ver_cache;
+
+    // Whether a driver meeting min_version has been found
+    bool meets_minimum(void) const {
+        return this->min_version > 0 && this->found &&
+               this->found->version >= this->min_version;
+    }
+
+    // Whether enough drivers meeting min_version have been found, counting
+    // the fallbacks, that the remaining candidates can be skipped
+    bool satisfied(void) const {
+        return this->meets_minimum() &&
+               static_cast<size_t>(std::ranges::count_if(
+                   this->validated, [this](const SearchResult &result) {
+                       return result.version >= this->min_version;
+                   })) >= this->num_wanted;
+    }
 };
 
+// Use the driver pinned by the admin configuration, if any, without probing it
+void search_pinned_driver(SearchState &state);
+
+// Search and probe the admin configuration's priority directories
+void search_priority_paths(SearchState &state);
+
+void find_required_version(const std::vector<std::filesystem::path> &libs,
+                           SearchState &state);
+
 void search_libraries_libcuda(const std::vector<std::filesystem::path> &libs,
                               SearchState &state);
 
@@ -49,9 +176,28 @@ void search_cuda_home(SearchState &state);
 void search_paths_libcudart(const std::vector<std::filesystem::path> &paths,
                             SearchState &state);
 
+// Search the toolkit install prefixes, the admin configuration's or else
+// /usr/local and the HPC SDK's, listing each once and checking their
+// toolkits' compat drivers newest first
+void search_toolkit_prefixes(SearchState &state);
+
 void search_paths_libcuda(const std::vector<std::filesystem::path> &paths,
                           SearchState &state);
 
+// Probe the candidates queued by the search_* functions.  Without a minimum
+// version they're probed in order of descending version bound, using the
+// probe history to break ties, so the probes for candidates that can't beat
+// the best found so far can be skipped.  With a minimum version they're
+// probed in search order, deferring any whose bound is too low to satisfy
+// it.  Candidates in slow_paths are always probed last.
+void probe_candidates(SearchState &state);
+
+// Get up to count validated drivers, best first
+std::vector<SearchResult> rank_results(const SearchState &state, size_t count);
+
+// Record the outcome of this search in the probe history
+void record_history(SearchState &state);
+
 } // namespace autocompat
 
 #endif // CUDA_AUTOCOMPAT_SEARCH_SEARCH_H
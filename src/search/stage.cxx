@@ -0,0 +1,241 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stage.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "admin_config.h"
+#include "driver_libs.h"
+#include "fingerprint.h"
+#include "logging.h"
+
+namespace autocompat {
+
+namespace {
+
+constexpr auto DEFAULT_STAGE_DIR = "/dev/shm";
+
+// The file in each staged directory naming the directory it was copied from
+constexpr auto SOURCE_FILENAME = "source";
+
+// Get this user's directory under the configured stage directory, which has
+// to be a real directory only the user can write to since everything in it
+// is loaded without being probed.  The cache can't be shared by every user
+// on the node for the same reason: any of them could replace a copy the
+// others would then load.
+std::optional<std::filesystem::path> get_user_stage_dir(bool create) {
+    std::filesystem::path stage_dir = DEFAULT_STAGE_DIR;
+    if (ADMIN_CONFIG.stage_dir.len > 0) {
+        stage_dir = std::string_view(ADMIN_CONFIG.stage_dir.str,
+                                     ADMIN_CONFIG.stage_dir.len);
+    }
+    stage_dir /= std::format("cuda-autocompat-{}", ::getuid());
+
+    if (create) {
+        std::error_code ec;
+        std::filesystem::create_directories(stage_dir.parent_path(), ec);
+        if (::mkdir(stage_dir.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+            log_warn("{}: {}", stage_dir, std::strerror(errno));
+            return std::nullopt;
+        }
+    }
+    struct stat dir_stat{};
+    if (::lstat(stage_dir.c_str(), &dir_stat) != 0) {
+        if (create) {
+            log_warn("{}: {}", stage_dir, std::strerror(errno));
+        }
+        return std::nullopt;
+    }
+    if (!S_ISDIR(dir_stat.st_mode) || dir_stat.st_uid != ::getuid() ||
+        (dir_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        log_warn("{}: Not a private directory, not staging", stage_dir);
+        return std::nullopt;
+    }
+    return stage_dir;
+}
+
+std::optional<SearchResult> get_staged(const SearchResult &result,
+                                       const std::filesystem::path &dir) {
+    struct stat libcuda_stat{};
+    if (::stat((dir / "libcuda.so.1").c_str(), &libcuda_stat) != 0) {
+        return std::nullopt;
+    }
+    SearchResult staged = result;
+    staged.driver_dir = dir;
+    staged.fingerprint = autocompat_fingerprint(
+        libcuda_stat.st_dev, libcuda_stat.st_ino, libcuda_stat.st_size,
+        libcuda_stat.st_mtim.tv_sec, libcuda_stat.st_mtim.tv_nsec);
+    staged.dir_inode = 0;
+    return staged;
+}
+
+// Whether a result's directory is under one of the stage prefixes
+bool is_staged_dir(const std::filesystem::path &dir) {
+    const auto &native = dir.native();
+    return admin_config_stages(&ADMIN_CONFIG, native.data(),
+                               static_cast<int>(native.size()));
+}
+
+// Copy the driver libraries the source directory has into a new directory,
+// recording where they came from
+bool copy_driver_libs(const std::filesystem::path &src_dir,
+                      const std::filesystem::path &dst_dir) {
+    constexpr std::array<const char *, DRIVER_LIB_COUNT> sonames =
+        DRIVER_LIB_SONAMES_INIT;
+
+    std::error_code ec;
+    std::filesystem::create_directory(dst_dir, ec);
+    if (ec) {
+        log_warn("{}: {}", dst_dir, ec.message());
+        return false;
+    }
+    for (size_t lib = 0; lib < sonames.size(); ++lib) {
+        const auto src = src_dir / sonames[lib];
+        if (lib >= DRIVER_LIB_REQUIRED_COUNT &&
+            !std::filesystem::exists(src, ec)) {
+            continue;
+        }
+        // Symlinks, i.e. libcuda.so.1 -> libcuda.so.<version>, are followed
+        // so the copies are regular files with the sonames
+        std::filesystem::copy_file(src, dst_dir / sonames[lib], ec);
+        if (ec) {
+            log_warn("{}: {}", src, ec.message());
+            return false;
+        }
+    }
+    std::ofstream source_file(dst_dir / SOURCE_FILENAME);
+    source_file << src_dir.native();
+    return true;
+}
+
+// Remove the copies staged from the same source directory before its driver
+// was replaced, which would otherwise stay in the stage directory, often
+// memory on /dev/shm, for good.  Processes still using an old copy keep
+// their mappings of it.
+void remove_stale_copies(const std::filesystem::path &stage_dir,
+                         const std::filesystem::path &src_dir,
+                         const std::string &current_key) {
+    std::error_code ec;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(stage_dir, ec)) {
+        const auto key = entry.path().filename().native();
+        if (key.size() != 16 || key == current_key ||
+            key.find_first_not_of("0123456789abcdef") != std::string::npos) {
+            continue;
+        }
+        std::ifstream source_file(entry.path() / SOURCE_FILENAME);
+        std::string source;
+        if (!std::getline(source_file, source) || source != src_dir.native()) {
+            continue;
+        }
+        log_info("Removing stale staged copy {}", entry.path());
+        std::error_code remove_ec;
+        std::filesystem::remove_all(entry.path(), remove_ec);
+        std::filesystem::remove(
+            stage_dir / std::format("{}.lock", key), remove_ec);
+    }
+}
+
+} // end anonymous namespace
+
+std::optional<std::filesystem::path>
+find_staged_libcuda(const std::filesystem::path &libcuda_path,
+                    uint64_t fingerprint) {
+    if (fingerprint == 0 || !is_staged_dir(libcuda_path.parent_path())) {
+        return std::nullopt;
+    }
+    const auto stage_dir = get_user_stage_dir(false);
+    if (!stage_dir) {
+        return std::nullopt;
+    }
+    auto staged_path =
+        *stage_dir / std::format("{:016x}", fingerprint) / "libcuda.so.1";
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(staged_path, ec)) {
+        return std::nullopt;
+    }
+    return staged_path;
+}
+
+std::optional<SearchResult> stage_driver(const SearchResult &result) {
+    if (result.fingerprint == 0 || !is_staged_dir(result.driver_dir)) {
+        return std::nullopt;
+    }
+    const auto stage_dir = get_user_stage_dir(true);
+    if (!stage_dir) {
+        return std::nullopt;
+    }
+
+    const auto key = std::format("{:016x}", result.fingerprint);
+    const auto dir = *stage_dir / key;
+    if (auto staged = get_staged(result, dir)) {
+        log_info("Using staged copy {}", dir);
+        return staged;
+    }
+
+    // Only one process per node copies the libraries while the rest wait on
+    // the lock and then use its copy.  The lock is released when its holder
+    // exits, however it exits.
+    const auto lock_path = *stage_dir / std::format("{}.lock", key);
+    const int lock_fd =
+        ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (lock_fd < 0) {
+        log_warn("{}: {}", lock_path, std::strerror(errno));
+        return std::nullopt;
+    }
+    while (::flock(lock_fd, LOCK_EX) != 0 && errno == EINTR) {
+    }
+
+    auto staged = get_staged(result, dir);
+    if (staged) {
+        log_info("Using staged copy {}", dir);
+    } else {
+        // Copy to a private directory and rename it into place so the staged
+        // directory is never seen partially copied
+        log_info("Staging {} to {}", result.driver_dir, dir);
+        const auto tmp_dir = *stage_dir / std::format("{}.{}", key, ::getpid());
+        std::error_code ec;
+        std::filesystem::remove_all(tmp_dir, ec);
+        if (copy_driver_libs(result.driver_dir, tmp_dir)) {
+            std::filesystem::rename(tmp_dir, dir, ec);
+            if (ec) {
+                log_warn("{}: {}", dir, ec.message());
+            } else {
+                staged = get_staged(result, dir);
+                remove_stale_copies(*stage_dir, result.driver_dir, key);
+            }
+        }
+        std::filesystem::remove_all(tmp_dir, ec);
+    }
+
+    (void)::close(lock_fd);
+    return staged;
+}
+
+} // namespace autocompat
@@ -0,0 +1,50 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CUDA_AUTOCOMPAT_SEARCH_STAGE_H
+#define CUDA_AUTOCOMPAT_SEARCH_STAGE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "search.h"
+
+namespace autocompat {
+
+// Copy the driver libraries of a result under one of the admin
+// configuration's stage prefixes to a node-local cache, i.e. so thousands of
+// processes on a node set don't all read a toolkit's compat libraries from a
+// shared filesystem.  Copies live in <stage_dir>/cuda-autocompat-<uid>/ in a
+// directory named for the fingerprint of the original libcuda.so.1, so
+// replacing the driver stages it again and removes the copy of the old one,
+// and are made by one process at a time while any others wait to use its
+// copy.  The cache is per user since its copies are loaded without being
+// probed, so only the user may be able to write to it.
+//
+// return:
+//   The result for the staged copy; nullopt if staging isn't configured for
+//   the result's directory or it failed, where the original should be used
+std::optional<SearchResult> stage_driver(const SearchResult &result);
+
+// The staged copy of a libcuda.so.1 with the given fingerprint, if there is
+// one, for the search to probe instead of reading the original again
+std::optional<std::filesystem::path>
+find_staged_libcuda(const std::filesystem::path &libcuda_path,
+                    uint64_t fingerprint);
+
+} // namespace autocompat
+
+#endif // CUDA_AUTOCOMPAT_SEARCH_STAGE_H
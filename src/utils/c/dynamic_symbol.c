@@ -0,0 +1,217 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dynamic_symbol.h"
+
+#include <elf.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gnu_hash.h"
+
+// Both supported architectures are 64-bit and only use RELA relocations
+#if defined(__x86_64__)
+    #define IMPORT_JUMP_SLOT R_X86_64_JUMP_SLOT
+    #define IMPORT_GLOB_DAT R_X86_64_GLOB_DAT
+#elif defined(__aarch64__)
+    #define IMPORT_JUMP_SLOT R_AARCH64_JUMP_SLOT
+    #define IMPORT_GLOB_DAT R_AARCH64_GLOB_DAT
+#endif
+#define RELA_SYM(info) ELF64_R_SYM(info)
+#define RELA_TYPE(info) ELF64_R_TYPE(info)
+
+void *lookup_dynamic_symbol(const struct link_map *map, const char *name) {
+    autocompat_gnu_hash table;
+    if (!autocompat_gnu_hash_init(&table, map)) {
+        return NULL;
+    }
+    const ElfW(Sym) *sym = autocompat_gnu_hash_lookup(&table, name);
+    return sym ? (void *)(map->l_addr + sym->st_value) : NULL;
+}
+
+#ifdef IMPORT_JUMP_SLOT
+
+typedef struct {
+    ElfW(Addr) base;
+    ElfW(Addr) start;
+    ElfW(Addr) end;
+} relro_range;
+
+static int find_relro(struct dl_phdr_info *info, size_t size, void *data) {
+    (void)size;
+    relro_range *relro = data;
+    if (info->dlpi_addr != relro->base) {
+        return 0;
+    }
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_GNU_RELRO) {
+            relro->start = info->dlpi_addr + phdr->p_vaddr;
+            relro->end = relro->start + phdr->p_memsz;
+        }
+    }
+    return 1;
+}
+
+// Store value in a GOT entry, temporarily unprotecting it if it's in the
+// object's RELRO segment
+static bool write_got_entry(void **entry, void *value,
+                            const relro_range *relro) {
+    ElfW(Addr) addr = (ElfW(Addr))entry;
+    if (addr < relro->start || addr >= relro->end) {
+        *entry = value;
+        return true;
+    }
+
+    uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    void *page = (void *)(addr & ~(page_size - 1));
+    if (mprotect(page, page_size, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    *entry = value;
+    return mprotect(page, page_size, PROT_READ) == 0;
+}
+
+int rewrite_dynamic_imports(const struct link_map *map,
+                            dynamic_import_visitor visit, void *data) {
+    if (!map || !map->l_ld) {
+        return 0;
+    }
+
+    ElfW(Addr) symtab_addr = 0;
+    ElfW(Addr) strtab_addr = 0;
+    ElfW(Addr) rela_addr = 0;
+    size_t rela_size = 0;
+    ElfW(Addr) jmprel_addr = 0;
+    size_t jmprel_size = 0;
+    bool jmprel_is_rela = false;
+    for (const ElfW(Dyn) *dyn = map->l_ld; dyn->d_tag != DT_NULL; ++dyn) {
+        switch (dyn->d_tag) {
+        case DT_SYMTAB:
+            symtab_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_STRTAB:
+            strtab_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_RELA:
+            rela_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_RELASZ:
+            rela_size = dyn->d_un.d_val;
+            break;
+        case DT_JMPREL:
+            jmprel_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_PLTRELSZ:
+            jmprel_size = dyn->d_un.d_val;
+            break;
+        case DT_PLTREL:
+            jmprel_is_rela = dyn->d_un.d_val == DT_RELA;
+            break;
+        default:
+            break;
+        }
+    }
+    if (!symtab_addr || !strtab_addr || (jmprel_addr && !jmprel_is_rela)) {
+        return 0;
+    }
+
+    if (symtab_addr < map->l_addr) {
+        symtab_addr += map->l_addr;
+        strtab_addr += map->l_addr;
+        rela_addr += rela_addr ? map->l_addr : 0;
+        jmprel_addr += jmprel_addr ? map->l_addr : 0;
+    }
+    const ElfW(Sym) *symtab = (const ElfW(Sym) *)symtab_addr;
+    const char *strtab = (const char *)strtab_addr;
+
+    relro_range relro = {map->l_addr, 0, 0};
+    (void)dl_iterate_phdr(find_relro, &relro);
+
+    // Calls go through PLT entries and address-taken or -z now calls through
+    // GLOB_DAT entries; either may be used for the same symbol
+    const struct {
+        ElfW(Addr) addr;
+        size_t size;
+    } tables[] = {{jmprel_addr, jmprel_size}, {rela_addr, rela_size}};
+
+    int rewritten = 0;
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); ++t) {
+        const ElfW(Rela) *rela = (const ElfW(Rela) *)tables[t].addr;
+        size_t count = rela ? tables[t].size / sizeof(ElfW(Rela)) : 0;
+        for (size_t i = 0; i < count; ++i) {
+            ElfW(Xword) type = RELA_TYPE(rela[i].r_info);
+            if (type != IMPORT_JUMP_SLOT && type != IMPORT_GLOB_DAT) {
+                continue;
+            }
+            const ElfW(Sym) *sym = &symtab[RELA_SYM(rela[i].r_info)];
+            if (sym->st_shndx != SHN_UNDEF) {
+                continue;
+            }
+            void **entry = (void **)(map->l_addr + rela[i].r_offset);
+            void *replacement = visit(strtab + sym->st_name, *entry, data);
+            if (!replacement) {
+                continue;
+            }
+            if (!write_got_entry(entry, replacement, &relro)) {
+                return rewritten;
+            }
+            ++rewritten;
+        }
+    }
+    return rewritten;
+}
+
+typedef struct {
+    const char *name;
+    void *replacement;
+} import_redirect;
+
+static void *redirect_import(const char *name, void *current, void *data) {
+    (void)current;
+    const import_redirect *redirect = data;
+    return strcmp(name, redirect->name) == 0 ? redirect->replacement : NULL;
+}
+
+int redirect_dynamic_import(const struct link_map *map, const char *name,
+                            void *replacement) {
+    import_redirect redirect = {name, replacement};
+    return rewrite_dynamic_imports(map, redirect_import, &redirect);
+}
+
+#else
+
+int rewrite_dynamic_imports(const struct link_map *map,
+                            dynamic_import_visitor visit, void *data) {
+    (void)map;
+    (void)visit;
+    (void)data;
+    return 0;
+}
+
+int redirect_dynamic_import(const struct link_map *map, const char *name,
+                            void *replacement) {
+    (void)map;
+    (void)name;
+    (void)replacement;
+    return 0;
+}
+
+#endif
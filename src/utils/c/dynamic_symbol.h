@@ -0,0 +1,57 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_C_DYNAMIC_SYMBOL_H
+#define CUDA_AUTOCOMPAT_UTILS_C_DYNAMIC_SYMBOL_H
+
+#include <link.h>
+
+// Look up a defined symbol in a loaded object's dynamic symbol table
+// directly from its DT_GNU_HASH table.  Unlike dlsym this doesn't go through
+// the dynamic linker so it's safe to use from the audit interface callbacks,
+// including for objects in other namespaces.  See gnu_hash.h.
+//
+// return:
+//   The symbol's address; NULL if it isn't found or map has no DT_GNU_HASH
+void *lookup_dynamic_symbol(const struct link_map *map, const char *name);
+
+// Redirect the GOT entries through which a loaded object calls the function
+// name in another object to replacement, i.e. to hook the driver's own calls
+// to dlopen.  Only the object's own references are affected.  Entries
+// protected by RELRO are made writable just long enough to update them.
+//
+// return:
+//   The number of entries redirected; 0 if there were none, they couldn't
+//   be written, or the architecture's relocations aren't supported
+int redirect_dynamic_import(const struct link_map *map, const char *name,
+                            void *replacement);
+
+// Called with the symbol name and current value of each GOT entry through
+// which an object calls a function in another object
+//
+// return:
+//   The value to replace the entry with; NULL to leave it unchanged
+typedef void *(*dynamic_import_visitor)(const char *name, void *current,
+                                        void *data);
+
+// The general form of redirect_dynamic_import, rewriting whichever entries
+// visit chooses to
+//
+// return:
+//   The number of entries rewritten, stopping at the first that couldn't be
+//   written
+int rewrite_dynamic_imports(const struct link_map *map,
+                            dynamic_import_visitor visit, void *data);
+
+#endif // CUDA_AUTOCOMPAT_UTILS_C_DYNAMIC_SYMBOL_H
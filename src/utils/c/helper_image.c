@@ -0,0 +1,32 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The cuda-autocompat-search executable built into the loader libraries
+// when configured with AUTOCOMPAT_ENABLE_EMBEDDED_HELPER, so they run the
+// exact helper they were built with rather than looking for one on disk.
+// AUTOCOMPAT_EMBEDDED_HELPER is the path of the helper to include.
+//
+// The symbols are declared in search_helper.c, the only user.
+
+__asm__(".pushsection .rodata.autocompat_helper_image, \"a\", %progbits\n"
+        ".balign 64\n"
+        ".hidden autocompat_helper_image\n"
+        ".globl autocompat_helper_image\n"
+        "autocompat_helper_image:\n"
+        ".incbin \"" AUTOCOMPAT_EMBEDDED_HELPER "\"\n"
+        ".hidden autocompat_helper_image_end\n"
+        ".globl autocompat_helper_image_end\n"
+        "autocompat_helper_image_end:\n"
+        ".popsection\n");
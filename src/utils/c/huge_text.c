@@ -0,0 +1,146 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "huge_text.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Added in Linux 6.1
+#ifndef MADV_COLLAPSE
+    #define MADV_COLLAPSE 25
+#endif
+
+bool huge_text_requested(void) {
+    const char *value = secure_getenv(AUTOCOMPAT_HUGE_TEXT_ENV);
+    return value && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+// The PMD size huge pages are made of, which also tells whether the kernel
+// supports transparent huge pages at all
+static uintptr_t get_huge_page_size(void) {
+    int fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+                  O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    char buf[32];
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    (void)close(fd);
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+    return (uintptr_t)strtoull(buf, NULL, 10);
+}
+
+// Find the executable segment from the program headers, reached through the
+// ELF header that shared objects are linked to have at address 0.  Unlike
+// dl_iterate_phdr, which only sees the caller's namespace, this also works
+// from the audit interface for objects in the application's.
+static bool find_text(const struct link_map *map, uintptr_t *start,
+                      uintptr_t *end) {
+    const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)map->l_addr;
+    if (!ehdr || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_type != ET_DYN || ehdr->e_phentsize != sizeof(ElfW(Phdr))) {
+        return false;
+    }
+    const ElfW(Phdr) *phdrs =
+        (const ElfW(Phdr) *)(map->l_addr + ehdr->e_phoff);
+    for (ElfW(Half) i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_LOAD && (phdrs[i].p_flags & PF_X)) {
+            *start = map->l_addr + phdrs[i].p_vaddr;
+            *end = *start + phdrs[i].p_memsz;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Copy [start, start + len) to a huge page aligned anonymous mapping and
+// move it over the original
+static bool replace_with_copy(uintptr_t start, size_t len,
+                              uintptr_t huge_page_size) {
+    // Over-allocate so the copy can be aligned, which huge pages need both
+    // to be allocated and to be moved intact
+    size_t reserve_len = len + huge_page_size;
+    char *reserve = mmap(NULL, reserve_len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserve == MAP_FAILED) {
+        return false;
+    }
+    uintptr_t reserve_start = (uintptr_t)reserve;
+    uintptr_t copy_start =
+        (reserve_start + huge_page_size - 1) & ~(huge_page_size - 1);
+    if (copy_start > reserve_start) {
+        (void)munmap(reserve, copy_start - reserve_start);
+    }
+    uintptr_t reserve_end = reserve_start + reserve_len;
+    if (reserve_end > copy_start + len) {
+        (void)munmap((void *)(copy_start + len),
+                     reserve_end - (copy_start + len));
+    }
+
+    void *copy = (void *)copy_start;
+    if (madvise(copy, len, MADV_HUGEPAGE) != 0) {
+        (void)munmap(copy, len);
+        return false;
+    }
+    (void)memcpy(copy, (const void *)start, len);
+    __builtin___clear_cache((char *)copy, (char *)copy + len);
+    if (mprotect(copy, len, PROT_READ | PROT_EXEC) != 0 ||
+        mremap(copy, len, len, MREMAP_MAYMOVE | MREMAP_FIXED,
+               (void *)start) == MAP_FAILED) {
+        (void)munmap(copy, len);
+        return false;
+    }
+    return true;
+}
+
+size_t remap_text_huge(const struct link_map *map) {
+    uintptr_t huge_page_size = get_huge_page_size();
+    if (!map || huge_page_size == 0 ||
+        (huge_page_size & (huge_page_size - 1)) != 0) {
+        return 0;
+    }
+
+    uintptr_t text_start = 0;
+    uintptr_t text_end = 0;
+    if (!find_text(map, &text_start, &text_end)) {
+        return 0;
+    }
+    uintptr_t start = (text_start + huge_page_size - 1) & ~(huge_page_size - 1);
+    uintptr_t end = text_end & ~(huge_page_size - 1);
+    if (end <= start) {
+        return 0;
+    }
+    size_t len = end - start;
+
+    // MADV_HUGEPAGE alone would leave the collapse to khugepaged at some
+    // point later, which is too late for startup
+    if (madvise((void *)start, len, MADV_HUGEPAGE) == 0 &&
+        madvise((void *)start, len, MADV_COLLAPSE) == 0) {
+        return len;
+    }
+    return replace_with_copy(start, len, huge_page_size) ? len : 0;
+}
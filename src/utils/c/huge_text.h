@@ -0,0 +1,43 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_C_HUGE_TEXT_H
+#define CUDA_AUTOCOMPAT_UTILS_C_HUGE_TEXT_H
+
+#include <link.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Set to back the selected driver's text with transparent huge pages once
+// it's loaded, cutting the iTLB misses of launch-heavy applications running
+// through tens of megabytes of driver code mapped with 4 KiB pages
+#define AUTOCOMPAT_HUGE_TEXT_ENV "CUDA_AUTOCOMPAT_HUGE_TEXT"
+
+// Whether AUTOCOMPAT_HUGE_TEXT_ENV is set to anything but empty or "0"
+bool huge_text_requested(void);
+
+// Back the huge page aligned part of a loaded object's executable segment
+// with transparent huge pages.  It's collapsed in place with MADV_COLLAPSE
+// where the kernel and filesystem support that, keeping it backed by the
+// file and shared with other processes, and otherwise replaced by an
+// anonymous copy moved over it with mremap, which always leaves either the
+// original or the complete copy mapped.  Nothing may be running the
+// object's code while it's remapped, i.e. it has to be done while loading.
+//
+// return:
+//   The number of bytes now backed by huge pages; 0 if none were, i.e.
+//   transparent huge pages are disabled or the segment is too small
+size_t remap_text_huge(const struct link_map *map);
+
+#endif // CUDA_AUTOCOMPAT_UTILS_C_HUGE_TEXT_H
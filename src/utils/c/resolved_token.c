@@ -0,0 +1,108 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resolved_token.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "fingerprint.h"
+#include "path_utils.h"
+#include "search_helper.h"
+
+bool format_resolved_token(const search_result *result, uint64_t inputs,
+                           char *buf, size_t size) {
+    const char *libcuda_path = result->paths[DRIVER_LIB_LIBCUDA];
+    int dir_len = result->dir_len;
+    if (dir_len <= 0) {
+        return false;
+    }
+    int len = snprintf(buf, size, "%d:%016" PRIx64 ":%016" PRIx64 ":%d:%.*s",
+                       AUTOCOMPAT_RESOLVED_FORMAT, inputs, result->fingerprint,
+                       result->version, dir_len, libcuda_path);
+    return len > 0 && (size_t)len < size;
+}
+
+// Parse a fixed-width hex field followed by a colon
+static const char *parse_hex_field(const char *cursor, uint64_t *out) {
+    char *end = NULL;
+    errno = 0;
+    *out = strtoull(cursor, &end, 16);
+    if (errno != 0 || end != cursor + 16 || *end != ':') {
+        return NULL;
+    }
+    return end + 1;
+}
+
+bool use_resolved_token(const char *token, uint64_t inputs,
+                        search_results *results) {
+    (void)memset(results, 0, sizeof(*results));
+
+    if (strcmp2(token, "1:") != 0) {
+        return false;
+    }
+    const char *cursor = token + strlen2("1:");
+
+    uint64_t token_inputs = 0;
+    uint64_t fingerprint = 0;
+    if (!(cursor = parse_hex_field(cursor, &token_inputs)) ||
+        token_inputs != inputs ||
+        !(cursor = parse_hex_field(cursor, &fingerprint))) {
+        return false;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    long version = strtol(cursor, &end, 10);
+    if (errno != 0 || end == cursor || *end != ':' || version < 0 ||
+        version > INT_MAX) {
+        return false;
+    }
+    const char *dir = end + 1;
+
+    search_result *entry = &results->entries[0];
+    if (!set_result_dir(entry, dir, (int)strlen(dir))) {
+        return false;
+    }
+
+    struct statx libcuda_statx;
+    if (statx(AT_FDCWD, entry->paths[DRIVER_LIB_LIBCUDA], 0,
+              STATX_TYPE | STATX_INO | STATX_SIZE | STATX_MTIME,
+              &libcuda_statx) != 0 ||
+        !S_ISREG(libcuda_statx.stx_mode) ||
+        autocompat_fingerprint(
+            makedev(libcuda_statx.stx_dev_major, libcuda_statx.stx_dev_minor),
+            libcuda_statx.stx_ino, libcuda_statx.stx_size,
+            libcuda_statx.stx_mtime.tv_sec,
+            libcuda_statx.stx_mtime.tv_nsec) != fingerprint) {
+        (void)memset(results, 0, sizeof(*results));
+        return false;
+    }
+
+    entry->version = (int)version;
+    entry->fingerprint = fingerprint;
+    results->count = 1;
+    results->inputs = inputs;
+    return true;
+}
@@ -0,0 +1,57 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_C_RESOLVED_TOKEN_H
+#define CUDA_AUTOCOMPAT_UTILS_C_RESOLVED_TOKEN_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "search_helper.h"
+
+// Once a process has resolved its driver the loader libraries export it to
+// the environment so descendants with the same search inputs, i.e. MPI ranks
+// or multiprocessing workers, can reuse it instead of searching again:
+//
+//   CUDA_AUTOCOMPAT_RESOLVED=1:<inputs>:<fingerprint>:<version>:<dir>
+//
+// where inputs is hash_search_inputs() of the process that resolved it and
+// fingerprint identifies dir/libcuda.so.1 (see fingerprint.h), both as 16
+// hex digits.  The directory is last so it may contain colons.
+#define AUTOCOMPAT_RESOLVED_ENV "CUDA_AUTOCOMPAT_RESOLVED"
+#define AUTOCOMPAT_RESOLVED_FORMAT 1
+
+// Large enough for any token value
+#define AUTOCOMPAT_RESOLVED_MAX (64 + PATH_MAX)
+
+// Format the token value for result
+//
+// return:
+//   true on success; false if it doesn't fit in size
+bool format_resolved_token(const search_result *result, uint64_t inputs,
+                           char *buf, size_t size);
+
+// Use an inherited token if it was resolved with the same search inputs and
+// its libcuda.so.1 is still the same file, checked with a single statx
+//
+// out:
+//   results - A single result for the token's driver directory
+// return:
+//   true if the token is usable
+bool use_resolved_token(const char *token, uint64_t inputs,
+                        search_results *results);
+
+#endif // CUDA_AUTOCOMPAT_UTILS_C_RESOLVED_TOKEN_H
@@ -14,17 +14,55 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "admin_config.h"
 #include "path_utils.h"
+#include "prefetch.h"
+#include "resolved_token.h"
+#include "search_helper.h"
+#include "search_order.h"
+#include "version.h"
+
+extern char **environ;
 
 #define HELPER_EXE "cuda-autocompat-search"
 
+const char *const driver_lib_sonames[DRIVER_LIB_COUNT] =
+    DRIVER_LIB_SONAMES_INIT;
+
+// Fill in the paths of libraries first through DRIVER_LIB_COUNT - 1
+static bool set_result_paths(search_result *result, int first,
+                             const char *dir, int dir_len) {
+    result->dir_len = dir_len;
+    for (int lib = first; lib < DRIVER_LIB_COUNT; ++lib) {
+        result->path_lens[lib] =
+            path_join(result->paths[lib], dir, dir_len,
+                      driver_lib_sonames[lib],
+                      (int)strlen(driver_lib_sonames[lib]));
+        if (result->path_lens[lib] < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool set_result_dir(search_result *result, const char *dir, int dir_len) {
+    return set_result_paths(result, 0, dir, dir_len);
+}
+
 bool find_search_helper(char out_path[PATH_MAX]) {
     const char *self_path = get_path_to_self();
     if (!self_path) {
@@ -60,7 +98,7 @@ bool find_search_helper(char out_path[PATH_MAX]) {
     const char *p_start = NULL;
     int p_len = 0;
     while ((path = next_token(path, &p_start, &p_len, ':'))) {
-        if (path_join2(out_path, p_start, p_len, HELPER_EXE) == -1) {
+        if (path_join2(out_path, p_start, p_len, HELPER_EXE) != -1) {
             if (access(out_path, R_OK | X_OK) == 0) {
                 return true;
             }
@@ -73,54 +111,427 @@ bool find_search_helper(char out_path[PATH_MAX]) {
     return false;
 }
 
-size_t find_libcuda(char out_path[PATH_MAX]) {
-    memset(out_path, 0, PATH_MAX);
+#ifdef AUTOCOMPAT_EMBEDDED_HELPER
+
+// Defined in helper_image.c
+extern const unsigned char autocompat_helper_image[];
+extern const unsigned char autocompat_helper_image_end[];
+
+// The version keeps libraries from different releases in the same process
+// tree from running each other's helper
+#define HELPER_MEMFD_NAME HELPER_EXE "-" CUDA_AUTOCOMPAT_VERSION_STRING
+
+#define HELPER_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+// Since Linux 6.3 memfds may be created non-executable by default
+#ifndef MFD_EXEC
+    #define MFD_EXEC 0x0010U
+#endif
+
+// -2 until looked for; see embedded_helper_fd
+static int helper_memfd = -2;
+
+static size_t helper_image_size(void) {
+    return (size_t)(autocompat_helper_image_end - autocompat_helper_image);
+}
 
+// Whether fd is a sealed memfd holding a helper from the same release
+static bool is_helper_memfd(int fd) {
+    struct stat fd_stat;
+    if (fstat(fd, &fd_stat) != 0 || !S_ISREG(fd_stat.st_mode) ||
+        (size_t)fd_stat.st_size != helper_image_size() ||
+        fcntl(fd, F_GET_SEALS) != HELPER_SEALS) {
+        return false;
+    }
+
+    char fd_path[32];
+    char target[64];
+    (void)snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+    ssize_t target_len = readlink(fd_path, target, sizeof(target) - 1);
+    if (target_len < 0) {
+        return false;
+    }
+    target[target_len] = '\0';
+    return strcmp(target, "/memfd:" HELPER_MEMFD_NAME " (deleted)") == 0;
+}
+
+static int create_helper_memfd(void) {
+    // Older kernels reject the unknown flag but create executable memfds
+    int fd = memfd_create(HELPER_MEMFD_NAME, MFD_ALLOW_SEALING | MFD_EXEC);
+    if (fd < 0 && errno == EINVAL) {
+        fd = memfd_create(HELPER_MEMFD_NAME, MFD_ALLOW_SEALING);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    const unsigned char *cursor = autocompat_helper_image;
+    size_t remaining = helper_image_size();
+    while (remaining > 0) {
+        ssize_t n = write(fd, cursor, remaining);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        cursor += n;
+        remaining -= (size_t)n;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, HELPER_SEALS) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Get the embedded helper's memfd, reusing one inherited from an ancestor
+// if there is one.  The memfd is deliberately left open across exec.
+static int open_embedded_helper(void) {
+    if (helper_memfd != -2) {
+        return helper_memfd;
+    }
+
+    const char *inherited = secure_getenv(AUTOCOMPAT_HELPER_FD_ENV);
+    if (inherited && inherited[0] != '\0') {
+        char *end = NULL;
+        errno = 0;
+        long fd = strtol(inherited, &end, 10);
+        if (errno == 0 && *end == '\0' && fd >= 0 && fd <= INT_MAX &&
+            is_helper_memfd((int)fd)) {
+            helper_memfd = (int)fd;
+            return helper_memfd;
+        }
+    }
+
+    helper_memfd = create_helper_memfd();
+    return helper_memfd;
+}
+
+int embedded_helper_fd(void) { return helper_memfd >= 0 ? helper_memfd : -1; }
+
+#else
+
+static int open_embedded_helper(void) { return -1; }
+
+int embedded_helper_fd(void) { return -1; }
+
+#endif // AUTOCOMPAT_EMBEDDED_HELPER
+
+// A small buffered reader for the NUL-terminated fields of the helper's
+// response
+typedef struct {
+    int fd;
+    size_t pos;
+    size_t len;
+    char buf[4096];
+} field_reader;
+
+// Read the next field into dst, which must be large enough for it and its
+// terminator
+//
+// return:
+//   The length of the field; -1 on error, truncation, or end of input
+static int read_field(field_reader *r, char *dst, size_t dst_size) {
+    size_t len = 0;
+    for (;;) {
+        if (r->pos == r->len) {
+            ssize_t n = read(r->fd, r->buf, sizeof(r->buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return -1;
+            }
+            r->pos = 0;
+            r->len = (size_t)n;
+        }
+
+        const char *start = r->buf + r->pos;
+        size_t avail = r->len - r->pos;
+        const char *eod = memchr(start, '\0', avail);
+        size_t n = eod ? (size_t)(eod - start) : avail;
+        if (len + n >= dst_size) {
+            return -1;
+        }
+        (void)memcpy(dst + len, start, n);
+        len += n;
+        r->pos += n;
+        if (eod) {
+            r->pos += 1;
+            dst[len] = '\0';
+            return (int)len;
+        }
+    }
+}
+
+// Read a numeric field in the given base
+static bool read_number_field(field_reader *r, int base, uint64_t *out) {
+    char field[32];
+    if (read_field(r, field, sizeof(field)) <= 0) {
+        return false;
+    }
+    char *end = NULL;
+    errno = 0;
+    *out = strtoull(field, &end, base);
+    return errno == 0 && *end == '\0';
+}
+
+// return:
+//   The number of results read; -1 if the response is malformed
+static int read_results(int fd, search_results *results) {
+    field_reader r;
+    r.fd = fd;
+    r.pos = 0;
+    r.len = 0;
+
+    char magic[sizeof(AUTOCOMPAT_RESULTS_MAGIC)];
+    uint64_t format = 0;
+    uint64_t count = 0;
+    if (read_field(&r, magic, sizeof(magic)) < 0 ||
+        strcmp(magic, AUTOCOMPAT_RESULTS_MAGIC) != 0 ||
+        !read_number_field(&r, 10, &format) ||
+        format != AUTOCOMPAT_RESULTS_FORMAT ||
+        !read_number_field(&r, 10, &count)) {
+        return -1;
+    }
+    if (count > AUTOCOMPAT_RESULTS_MAX) {
+        count = AUTOCOMPAT_RESULTS_MAX;
+    }
+
+    for (int i = 0; i < (int)count; ++i) {
+        search_result *entry = &results->entries[i];
+        uint64_t version = 0;
+        if (!read_number_field(&r, 10, &version) ||
+            !read_number_field(&r, 16, &entry->fingerprint)) {
+            return -1;
+        }
+        entry->version = (int)version;
+        for (int lib = 0; lib < DRIVER_LIB_REQUIRED_COUNT; ++lib) {
+            entry->path_lens[lib] =
+                read_field(&r, entry->paths[lib], PATH_MAX);
+            if (entry->path_lens[lib] <= 0) {
+                return -1;
+            }
+        }
+
+        // The optional libraries are only ever looked for next to libcuda
+        const char *libcuda_path = entry->paths[DRIVER_LIB_LIBCUDA];
+        int dir_len = (int)(path_filename(libcuda_path,
+                                          entry->path_lens[DRIVER_LIB_LIBCUDA]) -
+                            libcuda_path) -
+                      1;
+        if (dir_len <= 0 ||
+            !set_result_paths(entry, DRIVER_LIB_REQUIRED_COUNT, libcuda_path,
+                              dir_len)) {
+            return -1;
+        }
+    }
+
+    return (int)count;
+}
+
+// The admin configuration is only read once per process
+static const admin_config *get_config(void) {
+    static admin_config config;
+    static bool loaded = false;
+    if (loaded) {
+        return &config;
+    }
+    loaded = true;
+
+    const char *path = get_admin_config_path();
+    if (!path) {
+        return &config;
+    }
+    int err = load_admin_config(path, &config);
+    if (err < 0) {
+        fprintf(stderr, "warning: Failed to read %s; ignoring\n", path);
+    } else if (err > 0) {
+        fprintf(stderr, "warning: %s:%d: Invalid setting; ignoring %s\n",
+                path, err, path);
+    }
+    return &config;
+}
+
+static bool use_pinned_driver(const admin_config *config,
+                              search_results *results) {
+    search_result *entry = &results->entries[0];
+    if (!admin_config_check_pin(config, entry->paths[DRIVER_LIB_LIBCUDA],
+                                &entry->fingerprint)) {
+        fprintf(stderr,
+                "warning: Pinned driver %.*s not found or stale; searching\n",
+                config->pin.len, config->pin.str);
+        return false;
+    }
+
+    if (!set_result_dir(entry, config->pin.str, config->pin.len)) {
+        return false;
+    }
+    entry->version = 0;
+    results->count = 1;
+    return true;
+}
+
+bool start_search(search_job *job, search_results *results) {
+    (void)memset(results, 0, sizeof(*results));
+    job->pid = -1;
+    job->out_fd = -1;
+    job->out_ino = 0;
+    job->count = 0;
+    job->inputs = 0;
+
+    // The JIT libraries are only loaded on demand so only the driver itself
+    // is worth prefetching
+    const admin_config *config = get_config();
+    if (config->pin.len > 0) {
+        if (use_pinned_driver(config, results)) {
+            autocompat_prefetch_file(results->entries[0].paths[DRIVER_LIB_LIBCUDA]);
+            results->outcome = AUTOCOMPAT_METRICS_PINNED;
+            job->count = results->count;
+            return true;
+        }
+        (void)memset(results, 0, sizeof(*results));
+    }
+
+    job->inputs = hash_search_inputs();
+    const char *token = secure_getenv(AUTOCOMPAT_RESOLVED_ENV);
+    if (token && use_resolved_token(token, job->inputs, results)) {
+        autocompat_prefetch_file(results->entries[0].paths[DRIVER_LIB_LIBCUDA]);
+        results->outcome = AUTOCOMPAT_METRICS_CACHED;
+        job->count = results->count;
+        return true;
+    }
+
+    // The embedded helper is run through its /proc/self/fd path, the same
+    // exec fexecve falls back to, since posix_spawn can't take a descriptor
     char search_helper_path[PATH_MAX];
-    if (!find_search_helper(search_helper_path)) {
+    int helper_fd = open_embedded_helper();
+    if (helper_fd >= 0) {
+        (void)snprintf(search_helper_path, sizeof(search_helper_path),
+                       "/proc/self/fd/%d", helper_fd);
+    } else if (!find_search_helper(search_helper_path)) {
         (void)fputs("error: Failed to locate cuda-autocompat-search helper\n",
                     stderr);
-        return 0;
+        return false;
     }
 
-    FILE *pipe = popen(search_helper_path, "r");
-    if (!pipe) {
+    // The helper's stdin is a socket rather than a pipe so the search
+    // arguments can be written with MSG_NOSIGNAL
+    int in_fds[2];
+    int out_fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, in_fds) != 0) {
+        (void)fputs("error: Failed to create search helper input\n", stderr);
+        return false;
+    }
+    if (pipe2(out_fds, O_CLOEXEC) != 0) {
+        (void)fputs("error: Failed to create search helper output\n", stderr);
+        close(in_fds[0]);
+        close(in_fds[1]);
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDOUT_FILENO);
+
+    char ranked_arg[] = "-r";
+    char ranked_count_arg[16];
+    (void)snprintf(ranked_count_arg, sizeof(ranked_count_arg), "%d",
+                   AUTOCOMPAT_RESULTS_MAX);
+    char stdin_arg[] = "-";
+    char *const argv[] = {search_helper_path, ranked_arg, ranked_count_arg,
+                          stdin_arg, NULL};
+    pid_t pid = -1;
+    int spawn_err = posix_spawn(&pid, search_helper_path, &actions, NULL,
+                                argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in_fds[1]);
+    close(out_fds[1]);
+    if (spawn_err != 0) {
         (void)fputs("error: Failed to execute search helper\n", stderr);
-        return 0;
+        close(in_fds[0]);
+        close(out_fds[0]);
+        return false;
     }
 
-    char *buf_cur = out_path;
-    size_t bytes_read;
-    size_t bytes_remaining = PATH_MAX - 1;
-    while (bytes_remaining > 0 &&
-           (bytes_read = fread(buf_cur, 1, bytes_remaining, pipe)) > 0) {
-        // Validate we have clean input and cut out early if we don't
-        void *eod;
-        if ((eod = memchr(buf_cur, '\0', bytes_read)) ||
-            (eod = memchr(buf_cur, '\n', bytes_read))) {
-            size_t eod_offset = (size_t)((char *)eod - buf_cur);
-            memset(eod, 0, bytes_read - eod_offset);
-            buf_cur = (char *)eod;
-            break;
-        }
+    // A failed write means the helper exited early; its exit status is what
+    // gets reported by finish_search
+    (void)write_search_order(in_fds[0]);
+    close(in_fds[0]);
+
+    struct stat out_stat;
+    job->pid = pid;
+    job->out_fd = out_fds[0];
+    job->out_ino = fstat(out_fds[0], &out_stat) == 0 ? out_stat.st_ino : 0;
+    return true;
+}
 
-        bytes_remaining -= bytes_read;
-        buf_cur += bytes_read;
+// Check that the job's output pipe is still the descriptor it was created
+// as, since the application may have closed it, i.e. by closing every
+// descriptor during startup, and reused the number for something else
+static bool job_output_valid(const search_job *job) {
+    struct stat out_stat;
+    return job->out_ino != 0 && fstat(job->out_fd, &out_stat) == 0 &&
+           S_ISFIFO(out_stat.st_mode) && out_stat.st_ino == job->out_ino;
+}
+
+int finish_search(search_job *job, search_results *results) {
+    if (job->pid == -1) {
+        return job->count;
+    }
+
+    bool output_valid = job_output_valid(job);
+    int count = output_valid ? read_results(job->out_fd, results) : -1;
+    if (output_valid) {
+        close(job->out_fd);
     }
+    job->out_fd = -1;
 
-    int ret = pclose(pipe);
-    if (ret == -1) {
+    int status = 0;
+    pid_t waited = -1;
+    while ((waited = waitpid(job->pid, &status, 0)) == -1 && errno == EINTR) {
+    }
+    job->pid = -1;
+    if (!output_valid) {
+        (void)memset(results, 0, sizeof(*results));
+        return -1;
+    }
+
+    // The application may already have reaped the helper, i.e. with
+    // wait(-1), in which case a complete response is all there is to go on
+    if (waited == -1 && errno != ECHILD) {
         fputs("error: ", stderr);
         fputs(strerror(errno), stderr);
         fputc('\n', stderr);
-        memset(out_path, 0, PATH_MAX);
+        (void)memset(results, 0, sizeof(*results));
         return 0;
-    } else if (ret != 0) {
+    }
+    if (waited != -1 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
         fputs("error: Search helper failed\n", stderr);
-        memset(out_path, 0, PATH_MAX);
+        (void)memset(results, 0, sizeof(*results));
+        return 0;
+    }
+    if (count < 0) {
+        fputs("error: Invalid search helper response\n", stderr);
+        (void)memset(results, 0, sizeof(*results));
         return 0;
     }
 
-    return (size_t)(buf_cur - out_path);
+    results->count = count;
+    results->inputs = job->inputs;
+    results->outcome = AUTOCOMPAT_METRICS_SEARCHED;
+    return count;
 }
 
+int find_libcuda(search_results *results) {
+    search_job job;
+    if (!start_search(&job, results)) {
+        return 0;
+    }
+    int count = finish_search(&job, results);
+    return count > 0 ? count : 0;
+}
@@ -17,8 +17,89 @@
 
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "driver_libs.h"
+#include "metrics.h"
+#include "search_protocol.h"
+
+extern const char *const driver_lib_sonames[DRIVER_LIB_COUNT];
+
+typedef struct {
+    int version;
+    uint64_t fingerprint;
+    char paths[DRIVER_LIB_COUNT][PATH_MAX];
+    int path_lens[DRIVER_LIB_COUNT];
+
+    // The length of the driver directory prefix shared by the paths
+    int dir_len;
+} search_result;
+
+typedef struct {
+    int count;
+    search_result entries[AUTOCOMPAT_RESULTS_MAX];
+
+    // hash_search_inputs() of the search; see resolved_token.h
+    uint64_t inputs;
+
+    // How the results were found if there are any
+    autocompat_metrics_outcome outcome;
+} search_results;
+
+// Fill in result's library paths for the driver directory dir
+//
+// return:
+//   true on success; false if a path would be truncated
+bool set_result_dir(search_result *result, const char *dir, int dir_len);
 
 bool find_search_helper(char out_path[PATH_MAX]);
-size_t find_libcuda(char out_path[PATH_MAX]);
+
+// Holds the descriptor of the memfd the embedded helper is run from, left
+// open across exec so descendants can reuse it rather than creating their
+// own copy.  Only set by the loader libraries along with the resolved token.
+#define AUTOCOMPAT_HELPER_FD_ENV "CUDA_AUTOCOMPAT_HELPER_FD"
+
+// return:
+//   The embedded helper's memfd if a search has created or inherited one;
+//   -1 otherwise, including when built without AUTOCOMPAT_ENABLE_EMBEDDED_HELPER
+int embedded_helper_fd(void);
+
+// Run the search helper for the calling process and collect its ranked
+// results, best first, so a caller can fall back to the next entry if the
+// best fails to load.  If the admin configuration pins a driver directory
+// that still exists it's the only result and the helper isn't run at all;
+// its version is reported as 0 since it isn't probed.  The same goes for a
+// driver resolved by an ancestor process; see resolved_token.h.
+//
+// return:
+//   The number of results; 0 on error or if no usable driver was found
+int find_libcuda(search_results *results);
+
+// A search started by start_search that finish_search hasn't collected yet
+typedef struct {
+    pid_t pid; // -1 if no helper is running
+    int out_fd;
+    ino_t out_ino;
+    int count; // The result count if resolved without running the helper
+    uint64_t inputs;
+} search_job;
+
+// find_libcuda split in two so the caller can do other work while the helper
+// runs.  The helper's request is written before this returns so the caller's
+// environment only needs to be in its search state until then.
+//
+// return:
+//   true if the search was started or resolved without the helper; false
+//   on error
+bool start_search(search_job *job, search_results *results);
+
+// Wait for a search started by start_search and collect its results
+//
+// return:
+//   The number of results; 0 on error or if no usable driver was found; -1
+//   if the job's output was closed out from under it, in which case the
+//   search needs to be run again
+int finish_search(search_job *job, search_results *results);
 
 #endif // CUDA_AUTOCOMPAT_UTILS_C_SEARCH_HELPER_H
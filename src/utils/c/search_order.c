@@ -0,0 +1,374 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "search_order.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <limits.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "fingerprint.h"
+#include "path_utils.h"
+
+// A small fixed-size buffered writer so the arguments can be streamed to
+// the helper without any heap allocations.  Writes use send with MSG_NOSIGNAL
+// so a helper that exits early results in an error rather than a SIGPIPE
+// killing the host process, which requires fd to be a stream socket.  With
+// an fd of -1 the arguments are hashed instead.
+typedef struct {
+    int fd;
+    uint64_t hash;
+    bool failed;
+    const char *pending_flag;
+    bool list_started;
+    size_t len;
+    char buf[4096];
+} arg_writer;
+
+static void writer_flush(arg_writer *w) {
+    if (w->fd < 0) {
+        w->hash = autocompat_fnv1a(w->hash, w->buf, w->len);
+        w->len = 0;
+        return;
+    }
+
+    const char *cursor = w->buf;
+    size_t remaining = w->len;
+    while (!w->failed && remaining > 0) {
+        ssize_t n = send(w->fd, cursor, remaining, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EINTR) {
+                w->failed = true;
+            }
+            continue;
+        }
+        cursor += n;
+        remaining -= (size_t)n;
+    }
+    w->len = 0;
+}
+
+static void writer_put(arg_writer *w, const char *data, size_t len) {
+    while (!w->failed && len > 0) {
+        if (w->len == sizeof(w->buf)) {
+            writer_flush(w);
+        }
+        size_t n = sizeof(w->buf) - w->len;
+        if (n > len) {
+            n = len;
+        }
+        (void)memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+#define writer_put2(w, str) writer_put((w), (str), strlen2(str))
+
+// Write a complete argument from a string literal including its terminator
+#define writer_put_arg(w, str) writer_put((w), (str), sizeof(str))
+
+// Start a colon-separated list argument.  The flag itself is only written
+// once the first entry is added so empty lists don't produce a dangling flag
+// that would consume the next argument as its value.
+static void writer_begin_list(arg_writer *w, const char *flag) {
+    w->pending_flag = flag;
+    w->list_started = false;
+}
+
+static void writer_end_list(arg_writer *w) {
+    if (w->list_started) {
+        writer_put(w, "", 1);
+    }
+    w->pending_flag = NULL;
+    w->list_started = false;
+}
+
+// Add a single list entry, expanding $ORIGIN and ${ORIGIN} if origin is set
+static void writer_add_entry(arg_writer *w, const char *entry, int entry_len,
+                             const char *origin, int origin_len) {
+    if (!w->list_started) {
+        writer_put(w, w->pending_flag, strlen(w->pending_flag) + 1);
+        w->list_started = true;
+    } else {
+        writer_put2(w, ":");
+    }
+
+    const char *cursor = entry;
+    const char *end = entry + entry_len;
+    while (cursor < end) {
+        const char *dollar = memchr(cursor, '$', (size_t)(end - cursor));
+        if (!dollar) {
+            writer_put(w, cursor, (size_t)(end - cursor));
+            break;
+        }
+        writer_put(w, cursor, (size_t)(dollar - cursor));
+
+        size_t remaining = (size_t)(end - dollar);
+        if (origin && remaining >= strlen2("$ORIGIN") &&
+            strcmp2(dollar, "$ORIGIN") == 0) {
+            writer_put(w, origin, (size_t)origin_len);
+            cursor = dollar + strlen2("$ORIGIN");
+        } else if (origin && remaining >= strlen2("${ORIGIN}") &&
+                   strcmp2(dollar, "${ORIGIN}") == 0) {
+            writer_put(w, origin, (size_t)origin_len);
+            cursor = dollar + strlen2("${ORIGIN}");
+        } else {
+            writer_put2(w, "$");
+            cursor = dollar + 1;
+        }
+    }
+}
+
+static void writer_add_entries(arg_writer *w, const char *list,
+                               const char *origin, int origin_len) {
+    const char *token = NULL;
+    int token_len = 0;
+    while ((list = next_token(list, &token, &token_len, ':'))) {
+        writer_add_entry(w, token, token_len, origin, origin_len);
+    }
+}
+
+typedef struct {
+    const char *rpath;
+    const char *runpath;
+    int libcudart_major;
+    bool needs_libcuda;
+} main_exe_info;
+
+// Parse the major version N from a "libcudart.so.N" soname; -1 if name isn't
+// a libcudart soname
+static int parse_libcudart_major(const char *name) {
+    if (strcmp2(name, "libcudart.so.") != 0) {
+        return -1;
+    }
+    const char *cursor = name + strlen2("libcudart.so.");
+    int major = 0;
+    for (; *cursor >= '0' && *cursor <= '9'; ++cursor) {
+        major = (major * 10) + (*cursor - '0');
+        if (major > 1000) {
+            return -1;
+        }
+    }
+    return *cursor == '\0' && cursor != name + strlen2("libcudart.so.")
+               ? major
+               : -1;
+}
+
+// Locate the DT_RPATH, DT_RUNPATH, and DT_NEEDED strings of the main
+// executable directly from its program headers.  This works from la_version,
+// before the main program's link map is visible to dlinfo, as well as from a
+// constructor.
+static void get_main_exe_info(main_exe_info *info) {
+    info->rpath = NULL;
+    info->runpath = NULL;
+    info->libcudart_major = -1;
+    info->needs_libcuda = false;
+
+    const ElfW(Phdr) *phdr = (const ElfW(Phdr) *)getauxval(AT_PHDR);
+    size_t phnum = getauxval(AT_PHNUM);
+    if (!phdr || phnum == 0) {
+        return;
+    }
+
+    ElfW(Addr) bias = 0;
+    const ElfW(Phdr) *dyn_phdr = NULL;
+    for (size_t i = 0; i < phnum; ++i) {
+        if (phdr[i].p_type == PT_PHDR) {
+            bias = (ElfW(Addr))phdr - phdr[i].p_vaddr;
+        } else if (phdr[i].p_type == PT_DYNAMIC) {
+            dyn_phdr = &phdr[i];
+        }
+    }
+    if (!dyn_phdr) {
+        return;
+    }
+    const ElfW(Dyn) *dynamic = (const ElfW(Dyn) *)(bias + dyn_phdr->p_vaddr);
+
+    ElfW(Addr) strtab = 0;
+    for (const ElfW(Dyn) *dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+        if (dyn->d_tag == DT_STRTAB) {
+            strtab = dyn->d_un.d_ptr;
+            break;
+        }
+    }
+    if (strtab == 0) {
+        return;
+    }
+
+    // Depending on the architecture and glibc version the dynamic linker may
+    // or may not have already relocated the dynamic section in place
+    if (strtab < bias) {
+        strtab += bias;
+    }
+
+    const char *rpath = NULL;
+    for (const ElfW(Dyn) *dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+        const char *str = (const char *)(strtab + dyn->d_un.d_val);
+        switch (dyn->d_tag) {
+        case DT_RPATH:
+            rpath = str;
+            break;
+        case DT_RUNPATH:
+            info->runpath = str;
+            break;
+        case DT_NEEDED: {
+            int major = parse_libcudart_major(str);
+            if (major > info->libcudart_major) {
+                info->libcudart_major = major;
+            }
+            if (strcmp(str, "libcuda.so.1") == 0) {
+                info->needs_libcuda = true;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // DT_RPATH is ignored by the dynamic linker when DT_RUNPATH is present
+    if (!info->runpath) {
+        info->rpath = rpath;
+    }
+}
+
+static int write_loaded_lib(struct dl_phdr_info *info, size_t size,
+                            void *data) {
+    (void)size;
+    arg_writer *w = data;
+
+    // Skip the main executable, vdso, and anything else without a real path
+    if (info->dlpi_name && info->dlpi_name[0] == '/') {
+        writer_add_entry(w, info->dlpi_name, (int)strlen(info->dlpi_name),
+                         NULL, 0);
+    }
+    return w->failed ? 1 : 0;
+}
+
+static void put_search_order(arg_writer *w, bool include_loaded) {
+    char origin[PATH_MAX];
+    int origin_len = -1;
+    ssize_t exe_len = readlink("/proc/self/exe", origin, sizeof(origin) - 1);
+    if (exe_len > 0) {
+        origin[exe_len] = '\0';
+        origin_len = (int)(path_filename(origin, (int)exe_len) - origin) - 1;
+        if (origin_len == 0) {
+            origin_len = 1; // Executable in /
+        }
+    }
+    const char *origin_ptr = origin_len > 0 ? origin : NULL;
+
+    main_exe_info exe;
+    get_main_exe_info(&exe);
+
+    writer_begin_list(w, "-p");
+    if (exe.rpath) {
+        writer_add_entries(w, exe.rpath, origin_ptr, origin_len);
+    }
+    // The dynamic linker expands $ORIGIN in LD_LIBRARY_PATH too, except for
+    // secure-execution processes where it ignores the variable entirely
+    const char *ld_library_path = secure_getenv("LD_LIBRARY_PATH");
+    if (ld_library_path && getauxval(AT_SECURE) == 0) {
+        writer_add_entries(w, ld_library_path, origin_ptr, origin_len);
+    }
+    if (exe.runpath) {
+        writer_add_entries(w, exe.runpath, origin_ptr, origin_len);
+    }
+    writer_end_list(w);
+
+    if (include_loaded) {
+        writer_begin_list(w, "-l");
+        (void)dl_iterate_phdr(write_loaded_lib, w);
+        writer_end_list(w);
+    }
+
+    // With CUDA minor version compatibility any driver supporting N.0 can run
+    // an application linked against libcudart.so.N
+    if (exe.libcudart_major > 0) {
+        char min_version[16];
+        int min_version_len = snprintf(min_version, sizeof(min_version),
+                                       "%d000", exe.libcudart_major);
+        writer_put_arg(w, "-m");
+        writer_put(w, min_version, (size_t)min_version_len + 1);
+    }
+
+    // Let the helper append the system default search path after the
+    // application specific portion and then terminate the request with an
+    // empty argument
+    writer_put_arg(w, "-s");
+    writer_put(w, "", 1);
+}
+
+bool write_search_order(int fd) {
+    arg_writer w;
+    (void)memset(&w, 0, sizeof(w));
+    w.fd = fd;
+
+    put_search_order(&w, true);
+    writer_flush(&w);
+
+    return !w.failed;
+}
+
+bool main_exe_needs_driver(void) {
+    main_exe_info exe;
+    get_main_exe_info(&exe);
+    return exe.libcudart_major > 0 || exe.needs_libcuda;
+}
+
+// Add an environment variable's value, or its absence, to the hash
+static void put_env(arg_writer *w, const char *name) {
+    const char *value = secure_getenv(name);
+    writer_put(w, name, strlen(name) + 1);
+    if (value) {
+        writer_put(w, value, strlen(value) + 1);
+    } else {
+        writer_put2(w, "-");
+    }
+}
+
+uint64_t hash_search_inputs(void) {
+    arg_writer w;
+    (void)memset(&w, 0, sizeof(w));
+    w.fd = -1;
+    w.hash = AUTOCOMPAT_FNV1A_INIT;
+
+    put_search_order(&w, false);
+    put_env(&w, "CUDA_HOME");
+    put_env(&w, "CUDA_AUTOCOMPAT_CONFIG");
+
+    // Environments are often forwarded to other nodes, i.e. by MPI
+    // launchers, where a different search would be needed
+    struct utsname uts;
+    if (uname(&uts) == 0) {
+        writer_put(&w, uts.nodename, strlen(uts.nodename) + 1);
+    }
+    writer_flush(&w);
+
+    return w.hash;
+}
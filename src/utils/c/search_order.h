@@ -0,0 +1,46 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_C_SEARCH_ORDER_H
+#define CUDA_AUTOCOMPAT_UTILS_C_SEARCH_ORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Write the search helper arguments describing the calling process's
+// effective library search order and currently loaded libraries to fd as a
+// request for the helper's "-" (read arguments from stdin) mode:
+//
+//   -p <DT_RPATH>:<LD_LIBRARY_PATH>:<DT_RUNPATH> -l <loaded libs> [-m VER] -s
+//
+// in the NUL-delimited format described in search_protocol.h.  DT_RPATH is
+// only included when the main executable has no DT_RUNPATH, mirroring the
+// dynamic linker's own behavior, and $ORIGIN is expanded to the main
+// executable's directory.  If the main executable has a DT_NEEDED entry
+// for libcudart.so.N then the minimum required driver version is N.0.
+//
+// return:
+//   true on success; false if writing to fd failed
+bool write_search_order(int fd);
+
+// Whether the main executable has a DT_NEEDED entry for libcudart.so.N or
+// libcuda.so.1, i.e. it will almost certainly load the driver
+bool main_exe_needs_driver(void);
+
+// Hash everything that determines the search's result for the calling
+// process: the search order above without the loaded libraries, CUDA_HOME,
+// the admin configuration path, and the node's hostname
+uint64_t hash_search_inputs(void);
+
+#endif // CUDA_AUTOCOMPAT_UTILS_C_SEARCH_ORDER_H
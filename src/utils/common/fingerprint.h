@@ -0,0 +1,55 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_COMMON_FINGERPRINT_H
+#define CUDA_AUTOCOMPAT_UTILS_COMMON_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AUTOCOMPAT_FNV1A_INIT 0xcbf29ce484222325ULL
+
+// Update a 64-bit FNV-1a hash with len bytes of data
+static inline uint64_t autocompat_fnv1a(uint64_t hash, const void *data,
+                                        size_t len) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// A cheap identity for a file that changes whenever the file is replaced or
+// modified, computed from its stat metadata without reading any contents.
+// Shared by the C loader libraries and the C++ helper so both agree on the
+// value.  This is a 64-bit FNV-1a hash over the device, inode, size, and
+// modification time, each as little-endian 64-bit values.
+static inline uint64_t autocompat_fingerprint(uint64_t dev, uint64_t ino,
+                                              uint64_t size, int64_t mtime_sec,
+                                              uint32_t mtime_nsec) {
+    const uint64_t fields[] = {dev, ino, size, (uint64_t)mtime_sec,
+                               (uint64_t)mtime_nsec};
+    uint64_t hash = AUTOCOMPAT_FNV1A_INIT;
+    for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        unsigned char bytes[sizeof(uint64_t)];
+        for (unsigned int b = 0; b < sizeof(uint64_t); ++b) {
+            bytes[b] = (unsigned char)((fields[i] >> (b * 8)) & 0xffU);
+        }
+        hash = autocompat_fnv1a(hash, bytes, sizeof(bytes));
+    }
+    return hash;
+}
+
+#endif // CUDA_AUTOCOMPAT_UTILS_COMMON_FINGERPRINT_H
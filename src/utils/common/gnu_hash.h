@@ -0,0 +1,135 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_COMMON_GNU_HASH_H
+#define CUDA_AUTOCOMPAT_UTILS_COMMON_GNU_HASH_H
+
+#include <elf.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// A loaded object's DT_GNU_HASH table and the dynamic symbol table it
+// indexes, found with a single pass over its dynamic section so any number
+// of symbols can then be looked up without going through the dynamic
+// linker.  Shared by the C loader libraries and the C++ helper.
+typedef struct {
+    ElfW(Addr) base;
+    const ElfW(Sym) *symtab;
+    const char *strtab;
+    // NULL if the object has no symbol versions
+    const ElfW(Half) *versym;
+    uint32_t num_buckets;
+    uint32_t sym_offset;
+    const uint32_t *buckets;
+    const uint32_t *chain;
+} autocompat_gnu_hash;
+
+// return:
+//   true on success; false if map has no DT_GNU_HASH table
+static inline bool autocompat_gnu_hash_init(autocompat_gnu_hash *table,
+                                            const struct link_map *map) {
+    (void)memset(table, 0, sizeof(*table));
+    if (!map || !map->l_ld) {
+        return false;
+    }
+
+    ElfW(Addr) symtab_addr = 0;
+    ElfW(Addr) strtab_addr = 0;
+    ElfW(Addr) versym_addr = 0;
+    ElfW(Addr) gnu_hash_addr = 0;
+    for (const ElfW(Dyn) *dyn = map->l_ld; dyn->d_tag != DT_NULL; ++dyn) {
+        switch (dyn->d_tag) {
+        case DT_SYMTAB:
+            symtab_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_STRTAB:
+            strtab_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_VERSYM:
+            versym_addr = dyn->d_un.d_ptr;
+            break;
+        case DT_GNU_HASH:
+            gnu_hash_addr = dyn->d_un.d_ptr;
+            break;
+        default:
+            break;
+        }
+    }
+    if (!symtab_addr || !strtab_addr || !gnu_hash_addr) {
+        return false;
+    }
+
+    // Depending on the architecture the dynamic linker may or may not have
+    // already relocated the dynamic section in place
+    if (symtab_addr < map->l_addr) {
+        symtab_addr += map->l_addr;
+        strtab_addr += map->l_addr;
+        versym_addr += versym_addr ? map->l_addr : 0;
+        gnu_hash_addr += map->l_addr;
+    }
+    const uint32_t *header = (const uint32_t *)gnu_hash_addr;
+    if (header[0] == 0) {
+        return false;
+    }
+    const uint32_t bloom_size = header[2];
+    const ElfW(Addr) *bloom = (const ElfW(Addr) *)&header[4];
+
+    table->base = map->l_addr;
+    table->symtab = (const ElfW(Sym) *)symtab_addr;
+    table->strtab = (const char *)strtab_addr;
+    table->versym = (const ElfW(Half) *)versym_addr;
+    table->num_buckets = header[0];
+    table->sym_offset = header[1];
+    table->buckets = (const uint32_t *)&bloom[bloom_size];
+    table->chain = &table->buckets[table->num_buckets];
+    return true;
+}
+
+// Look up a symbol the object defines.  Like dlsym only the default version
+// of a versioned symbol is found, but unlike it the object's dependencies
+// aren't searched and IFUNC symbols aren't resolved.
+//
+// return:
+//   The symbol; NULL if it isn't found
+static inline const ElfW(Sym) *
+autocompat_gnu_hash_lookup(const autocompat_gnu_hash *table,
+                           const char *name) {
+    uint32_t hash = 5381;
+    for (const unsigned char *c = (const unsigned char *)name; *c; ++c) {
+        hash = (hash * 33) + *c;
+    }
+
+    uint32_t index = table->buckets[hash % table->num_buckets];
+    if (index < table->sym_offset) {
+        return NULL;
+    }
+    for (;;) {
+        const ElfW(Sym) *sym = &table->symtab[index];
+        const uint32_t chain_hash = table->chain[index - table->sym_offset];
+        if ((hash | 1) == (chain_hash | 1) && sym->st_shndx != SHN_UNDEF &&
+            (!table->versym || (table->versym[index] & 0x8000) == 0) &&
+            strcmp(table->strtab + sym->st_name, name) == 0) {
+            return sym;
+        }
+        if (chain_hash & 1) {
+            return NULL;
+        }
+        ++index;
+    }
+}
+
+#endif // CUDA_AUTOCOMPAT_UTILS_COMMON_GNU_HASH_H
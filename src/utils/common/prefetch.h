@@ -0,0 +1,36 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_COMMON_PREFETCH_H
+#define CUDA_AUTOCOMPAT_UTILS_COMMON_PREFETCH_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Start reading a file into the page cache without waiting for it, so that
+// once the driver has been selected the reads overlap with the rest of the
+// application's startup instead of being paid for as synchronous page faults
+// when it's loaded.  Shared by the C loader libraries, for drivers resolved
+// without the helper, and the helper itself.  Failures are ignored since
+// this is only ever an optimization.
+static inline void autocompat_prefetch_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    (void)close(fd);
+}
+
+#endif // CUDA_AUTOCOMPAT_UTILS_COMMON_PREFETCH_H
@@ -0,0 +1,51 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_COMMON_SEARCH_PROTOCOL_H
+#define CUDA_AUTOCOMPAT_UTILS_COMMON_SEARCH_PROTOCOL_H
+
+// The format of the messages exchanged between the loader libraries and the
+// cuda-autocompat-search helper.  Every field is a NUL-terminated string so
+// paths need no quoting or escaping.
+//
+// Request, written to the helper's stdin when it's run with "-":
+//
+//   <arg>\0<arg>\0...<arg>\0\0
+//
+// i.e. the helper's command line arguments, terminated by an empty argument.
+//
+// Response, written to the helper's stdout when it's run with -r K:
+//
+//   CUDA_AUTOCOMPAT_RESULTS\0<format version>\0<count>\0
+//
+// followed by count entries, best first, each made up of the fields:
+//
+//   <cuDriverGetVersion>\0<fingerprint>\0<libcuda.so.1 path>\0
+//   <libnvidia-nvvm.so.4 path>\0<libnvidia-ptxjitcompiler.so.1 path>\0
+//   <libcudadebugger.so.1 path>\0
+//
+// where the fingerprint of libcuda.so.1 is 16 hexadecimal digits; see
+// fingerprint.h.
+
+#define AUTOCOMPAT_RESULTS_MAGIC "CUDA_AUTOCOMPAT_RESULTS"
+#define AUTOCOMPAT_RESULTS_FORMAT 1
+
+// The most entries the loader libraries ask for and accept
+#define AUTOCOMPAT_RESULTS_MAX 4
+
+// Set by the helper in its own environment so a loader library it loads
+// while probing, i.e. the IFUNC shim, doesn't start a search of its own
+#define AUTOCOMPAT_HELPER_ENV "CUDA_AUTOCOMPAT_IN_HELPER"
+
+#endif // CUDA_AUTOCOMPAT_UTILS_COMMON_SEARCH_PROTOCOL_H
@@ -0,0 +1,251 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "admin_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "fingerprint.h"
+#include "materialized.h"
+
+#ifndef AUTOCOMPAT_DEFAULT_CONFIG_FILE
+#define AUTOCOMPAT_DEFAULT_CONFIG_FILE "/etc/cuda-autocompat.conf"
+#endif
+
+const char *get_admin_config_path(void) {
+    const char *path = secure_getenv("CUDA_AUTOCOMPAT_CONFIG");
+    if (!path) {
+        path = AUTOCOMPAT_DEFAULT_CONFIG_FILE;
+    }
+    return path[0] != '\0' ? path : NULL;
+}
+
+static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Trim leading and trailing blanks from [*start, *end)
+static void trim(const char **start, const char **end) {
+    while (*start < *end && is_blank(**start)) {
+        ++*start;
+    }
+    while (*end > *start && is_blank(*(*end - 1))) {
+        --*end;
+    }
+}
+
+static bool key_equals(const char *key, int key_len, const char *name) {
+    return (size_t)key_len == strlen(name) &&
+           strncmp(key, name, (size_t)key_len) == 0;
+}
+
+static bool add_entry(admin_config_str *entries, int *num_entries,
+                      const char *value, int value_len) {
+    if (*num_entries == ADMIN_CONFIG_MAX_ENTRIES) {
+        return false;
+    }
+    entries[*num_entries].str = value;
+    entries[*num_entries].len = value_len;
+    ++*num_entries;
+    return true;
+}
+
+static bool parse_max_probes(const char *value, int value_len, int *out) {
+    int max_probes = 0;
+    for (int i = 0; i < value_len; ++i) {
+        if (value[i] < '0' || value[i] > '9' || max_probes > 100000) {
+            return false;
+        }
+        max_probes = (max_probes * 10) + (value[i] - '0');
+    }
+    *out = max_probes;
+    return value_len > 0 && max_probes > 0;
+}
+
+static bool parse_line(admin_config *config, const char *start,
+                       const char *end) {
+    trim(&start, &end);
+    if (start == end || *start == '#') {
+        return true;
+    }
+
+    const char *eq = memchr(start, '=', (size_t)(end - start));
+    if (!eq) {
+        return false;
+    }
+    const char *key = start;
+    const char *key_end = eq;
+    const char *value = eq + 1;
+    const char *value_end = end;
+    trim(&key, &key_end);
+    trim(&value, &value_end);
+    int key_len = (int)(key_end - key);
+    int value_len = (int)(value_end - value);
+
+    // Everything that takes a path needs an absolute one that fits in a
+    // PATH_MAX buffer with a library name appended
+    bool is_path = value_len > 0 && value[0] == '/' &&
+                   value_len < PATH_MAX - (int)sizeof("/libcuda.so.1");
+
+    if (key_equals(key, key_len, "pin")) {
+        config->pin.str = value;
+        config->pin.len = value_len;
+        return is_path;
+    }
+    if (key_equals(key, key_len, "priority")) {
+        return is_path && add_entry(config->priority, &config->num_priority,
+                                    value, value_len);
+    }
+    // Ignore trailing slashes on prefixes so they match on path components
+    bool is_prefix = key_equals(key, key_len, "exclude") ||
+                     key_equals(key, key_len, "stage");
+    while (is_prefix && value_len > 1 && value[value_len - 1] == '/') {
+        --value_len;
+    }
+    if (key_equals(key, key_len, "exclude")) {
+        return is_path && add_entry(config->exclude, &config->num_exclude,
+                                    value, value_len);
+    }
+    if (key_equals(key, key_len, "stage")) {
+        return is_path && add_entry(config->stage, &config->num_stage, value,
+                                    value_len);
+    }
+    if (key_equals(key, key_len, "stage_dir")) {
+        config->stage_dir.str = value;
+        config->stage_dir.len = value_len;
+        return is_path;
+    }
+    if (key_equals(key, key_len, "toolkit_prefix")) {
+        return is_path && add_entry(config->toolkit_prefix,
+                                    &config->num_toolkit_prefix, value,
+                                    value_len);
+    }
+    if (key_equals(key, key_len, "max_probes")) {
+        return parse_max_probes(value, value_len, &config->max_probes);
+    }
+    return false;
+}
+
+int load_admin_config(const char *path, admin_config *config) {
+    (void)memset(config, 0, sizeof(*config));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct stat config_stat;
+    if (fstat(fd, &config_stat) != 0 || !S_ISREG(config_stat.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (config_stat.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    size_t map_len = (size_t)config_stat.st_size;
+    void *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    config->map = map;
+    config->map_len = map_len;
+
+    const char *cursor = config->map;
+    const char *end = config->map + map_len;
+    for (int line = 1; cursor < end; ++line) {
+        const char *eol = memchr(cursor, '\n', (size_t)(end - cursor));
+        if (!eol) {
+            eol = end;
+        }
+        if (!parse_line(config, cursor, eol)) {
+            (void)munmap(map, map_len);
+            (void)memset(config, 0, sizeof(*config));
+            return line;
+        }
+        cursor = eol + 1;
+    }
+
+    return 0;
+}
+
+static bool matches_prefix(const admin_config_str *prefixes, int num_prefixes,
+                           const char *path, int path_len) {
+    for (int i = 0; i < num_prefixes; ++i) {
+        const admin_config_str *prefix = &prefixes[i];
+        if (path_len < prefix->len ||
+            strncmp(path, prefix->str, (size_t)prefix->len) != 0) {
+            continue;
+        }
+        // Match whole components so /net doesn't match /network
+        if (path_len == prefix->len || path[prefix->len] == '/' ||
+            prefix->str[prefix->len - 1] == '/') {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool admin_config_excludes(const admin_config *config, const char *path,
+                           int path_len) {
+    return matches_prefix(config->exclude, config->num_exclude, path,
+                          path_len);
+}
+
+bool admin_config_stages(const admin_config *config, const char *path,
+                         int path_len) {
+    return matches_prefix(config->stage, config->num_stage, path, path_len);
+}
+
+bool admin_config_check_pin(const admin_config *config,
+                            char libcuda_path[PATH_MAX],
+                            uint64_t *fingerprint) {
+    if (config->pin.len == 0) {
+        return false;
+    }
+    (void)memcpy(libcuda_path, config->pin.str, (size_t)config->pin.len);
+    (void)memcpy(libcuda_path + config->pin.len, "/libcuda.so.1",
+                 sizeof("/libcuda.so.1"));
+
+    struct statx libcuda_statx;
+    if (statx(AT_FDCWD, libcuda_path, 0,
+              STATX_TYPE | STATX_INO | STATX_SIZE | STATX_MTIME,
+              &libcuda_statx) != 0 ||
+        !S_ISREG(libcuda_statx.stx_mode)) {
+        return false;
+    }
+
+    // A materialized directory whose driver was replaced since it was built
+    // has to be searched for again rather than used as-is
+    if (check_materialized_dir(config->pin.str, config->pin.len) == 0) {
+        return false;
+    }
+
+    *fingerprint = autocompat_fingerprint(
+        makedev(libcuda_statx.stx_dev_major, libcuda_statx.stx_dev_minor),
+        libcuda_statx.stx_ino, libcuda_statx.stx_size,
+        libcuda_statx.stx_mtime.tv_sec, libcuda_statx.stx_mtime.tv_nsec);
+    return true;
+}
@@ -0,0 +1,139 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_CONFIG_ADMIN_CONFIG_H
+#define CUDA_AUTOCOMPAT_UTILS_CONFIG_ADMIN_CONFIG_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An optional site configuration file letting administrators tell the search
+// where drivers live instead of having it rediscover them on every run.  It's
+// read from CUDA_AUTOCOMPAT_CONFIG if set, where an empty value disables it,
+// and from the default chosen at build time otherwise.  Each line is either
+// blank, a # comment, or a "key = value" setting:
+//
+//   # Use this driver without searching or probing as long as its
+//   # libcuda.so.1 exists
+//   pin = /opt/nvidia/driver/lib64
+//
+//   # Search these directories first, in order, and only fall back to the
+//   # full search if none of them has a usable driver
+//   priority = /usr/local/cuda/compat
+//   priority = /usr/lib64
+//
+//   # Never search under these prefixes, i.e. slow network mounts
+//   exclude = /net
+//
+//   # Stop after probing this many drivers
+//   max_probes = 4
+//
+//   # Copy drivers selected from under these prefixes, i.e. toolkits on a
+//   # shared filesystem, to a node-local cache and load them from there
+//   stage = /lustre
+//
+//   # Where the node-local copies are kept; /dev/shm if not set
+//   stage_dir = /tmp
+//
+//   # Directories of versioned toolkit installs, i.e. /usr/local/cuda-12.4,
+//   # whose compat drivers are searched newest first.  Shell wildcards are
+//   # expanded.  If not set, /usr/local and /opt/nvidia/hpc_sdk/*/*/cuda.
+//   toolkit_prefix = /usr/local
+//   toolkit_prefix = /opt/nvidia/hpc_sdk/Linux_x86_64/24.3/cuda
+//
+// priority, exclude, stage, and toolkit_prefix may be given up to
+// ADMIN_CONFIG_MAX_ENTRIES times.
+//
+// Copies of the same driver version, i.e. the system's and a toolkit's
+// compat driver, are otherwise tied and broken by which has more of its
+// libcuda.so.1 in the page cache.  Unprivileged users can only measure that
+// on Linux 6.5 through 6.13, with cachestat, or for files they own or can
+// write to; elsewhere only root's searches break the tie, and a priority
+// entry is the way to prefer one copy.
+
+#define ADMIN_CONFIG_MAX_ENTRIES 16
+
+// A string in the memory mapped file; not null-terminated
+typedef struct {
+    const char *str;
+    int len;
+} admin_config_str;
+
+typedef struct {
+    // The memory mapped file, which stays mapped for the life of the process
+    // since the settings point into it
+    const char *map;
+    size_t map_len;
+
+    admin_config_str pin;
+    admin_config_str priority[ADMIN_CONFIG_MAX_ENTRIES];
+    int num_priority;
+    admin_config_str exclude[ADMIN_CONFIG_MAX_ENTRIES];
+    int num_exclude;
+    admin_config_str stage[ADMIN_CONFIG_MAX_ENTRIES];
+    int num_stage;
+    admin_config_str stage_dir;
+    admin_config_str toolkit_prefix[ADMIN_CONFIG_MAX_ENTRIES];
+    int num_toolkit_prefix;
+
+    // 0 means unlimited
+    int max_probes;
+} admin_config;
+
+// Get the path of the configuration file; NULL if it's disabled
+const char *get_admin_config_path(void);
+
+// Map and parse the configuration file at path.  A missing file is the same
+// as an empty one.
+//
+// out:
+//   config - The parsed settings, left empty on error
+// return:
+//   0 on success; the line number of the first invalid line, or -1 if the
+//   file couldn't be read
+int load_admin_config(const char *path, admin_config *config);
+
+// Check whether path is equal to or under any of the excluded prefixes
+bool admin_config_excludes(const admin_config *config, const char *path,
+                           int path_len);
+
+// Check whether path is equal to or under any of the staged prefixes
+bool admin_config_stages(const admin_config *config, const char *path,
+                         int path_len);
+
+// Check the pinned driver directory with a single statx of its libcuda.so.1,
+// or of each library if it's a materialized driver directory; see
+// materialized.h
+//
+// out:
+//   libcuda_path - The pinned libcuda.so.1
+//   fingerprint  - Its fingerprint; see fingerprint.h
+// return:
+//   true if a driver is pinned, its libcuda.so.1 is a regular file, and it's
+//   current if it was materialized
+bool admin_config_check_pin(const admin_config *config,
+                            char libcuda_path[PATH_MAX],
+                            uint64_t *fingerprint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUDA_AUTOCOMPAT_UTILS_CONFIG_ADMIN_CONFIG_H
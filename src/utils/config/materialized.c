@@ -0,0 +1,139 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "materialized.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "fingerprint.h"
+
+// Large enough for the driver directory line and every library's line
+#define MANIFEST_MAX (PATH_MAX + 1024)
+
+static bool parse_fingerprint(const char *src, uint64_t *out) {
+    uint64_t value = 0;
+    for (int i = 0; i < 16; ++i) {
+        char c = src[i];
+        int digit = c >= '0' && c <= '9'   ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                                           : -1;
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | (uint64_t)digit;
+    }
+    *out = value;
+    return true;
+}
+
+// Check one "<fingerprint> <soname>" line
+//
+// return:
+//   1 if the library is current; 0 if it's stale; -1 if the line is invalid
+static int check_entry(const char *dir, int dir_len, const char *line,
+                       const char *eol) {
+    uint64_t recorded = 0;
+    if (eol - line < 18 || line[16] != ' ' ||
+        !parse_fingerprint(line, &recorded)) {
+        return -1;
+    }
+    const char *soname = line + 17;
+    int soname_len = (int)(eol - soname);
+    if (memchr(soname, '/', (size_t)soname_len)) {
+        return -1;
+    }
+
+    char lib_path[PATH_MAX];
+    int lib_path_len = snprintf(lib_path, sizeof(lib_path), "%.*s/%.*s",
+                                dir_len, dir, soname_len, soname);
+    if (lib_path_len < 0 || lib_path_len >= (int)sizeof(lib_path)) {
+        return -1;
+    }
+
+    struct statx lib_statx;
+    if (statx(AT_FDCWD, lib_path, 0,
+              STATX_TYPE | STATX_INO | STATX_SIZE | STATX_MTIME,
+              &lib_statx) != 0 ||
+        !S_ISREG(lib_statx.stx_mode)) {
+        return 0;
+    }
+    uint64_t fingerprint = autocompat_fingerprint(
+        makedev(lib_statx.stx_dev_major, lib_statx.stx_dev_minor),
+        lib_statx.stx_ino, lib_statx.stx_size, lib_statx.stx_mtime.tv_sec,
+        lib_statx.stx_mtime.tv_nsec);
+    return fingerprint == recorded ? 1 : 0;
+}
+
+int check_materialized_dir(const char *dir, int dir_len) {
+    char manifest_path[PATH_MAX];
+    int path_len = snprintf(manifest_path, sizeof(manifest_path), "%.*s/%s",
+                            dir_len, dir, MATERIALIZED_MANIFEST);
+    if (path_len < 0 || path_len >= (int)sizeof(manifest_path)) {
+        return -1;
+    }
+
+    int fd = open(manifest_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    char manifest[MANIFEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(manifest)) {
+        ssize_t n = read(fd, manifest + len, sizeof(manifest) - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fd);
+
+    static const char header[] = MATERIALIZED_MAGIC " 1\n";
+    _Static_assert(MATERIALIZED_FORMAT == 1, "Update the manifest header");
+    if (len == sizeof(manifest) || len < sizeof(header) - 1 ||
+        memcmp(manifest, header, sizeof(header) - 1) != 0) {
+        return -1;
+    }
+
+    int num_libs = 0;
+    const char *cursor = manifest + sizeof(header) - 1;
+    const char *end = manifest + len;
+    while (cursor < end) {
+        const char *eol = memchr(cursor, '\n', (size_t)(end - cursor));
+        if (!eol) {
+            return -1;
+        }
+        if (eol - cursor < 7 || memcmp(cursor, "driver ", 7) != 0) {
+            int current = check_entry(dir, dir_len, cursor, eol);
+            if (current <= 0) {
+                return current;
+            }
+            ++num_libs;
+        }
+        cursor = eol + 1;
+    }
+    return num_libs > 0 ? 1 : -1;
+}
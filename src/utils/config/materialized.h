@@ -0,0 +1,53 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_CONFIG_MATERIALIZED_H
+#define CUDA_AUTOCOMPAT_UTILS_CONFIG_MATERIALIZED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A materialized driver directory is built by the helper's --materialize
+// mode for nodes and images where the driver is resolved once rather than in
+// every process: it has a symlink for each of the selected driver's libraries
+// named for its soname, so it can simply be put on the library search path
+// or pinned in the admin configuration, and a manifest of what they point
+// to:
+//
+//   CUDA_AUTOCOMPAT_MATERIALIZED <format version>
+//   driver <driver directory>
+//   <fingerprint> <soname>
+//   ...
+//
+// with one line per library, where the fingerprint of the file the symlink
+// resolves to is 16 hexadecimal digits; see fingerprint.h.
+
+#define MATERIALIZED_MANIFEST "cuda-autocompat.manifest"
+#define MATERIALIZED_MAGIC "CUDA_AUTOCOMPAT_MATERIALIZED"
+#define MATERIALIZED_FORMAT 1
+
+// Check that dir's libraries still resolve to the files recorded in its
+// manifest, with a single statx of each.  Only the first dir_len characters
+// of dir are used.
+//
+// return:
+//   1 if it's current; 0 if it's stale; -1 if dir has no valid manifest
+int check_materialized_dir(const char *dir, int dir_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUDA_AUTOCOMPAT_UTILS_CONFIG_MATERIALIZED_H
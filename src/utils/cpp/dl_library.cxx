@@ -14,9 +14,15 @@
  */
 #include "dl_library.h"
 
+#include <cerrno>
+#include <cstring>
+
 #include <dlfcn.h>
+#include <elf.h>
 #include <link.h>
+#include <sys/stat.h>
 
+#include "gnu_hash.h"
 #include "logging.h"
 
 namespace autocompat {
@@ -25,6 +31,19 @@ DlLibrary::DlLibrary(const std::filesystem::path &lib_path) {
     (void)this->open(lib_path, RTLD_LAZY | RTLD_LOCAL);
 }
 
+DlLibrary::DlLibrary(DlLibrary &&other) noexcept
+    : handle(std::exchange(other.handle, nullptr)),
+      last_error(std::move(other.last_error)) {}
+
+DlLibrary &DlLibrary::operator=(DlLibrary &&other) noexcept {
+    if (this != &other) {
+        this->close();
+        this->handle = std::exchange(other.handle, nullptr);
+        this->last_error = std::move(other.last_error);
+    }
+    return *this;
+}
+
 DlLibrary::~DlLibrary(void) { this->close(); }
 
 DlLibrary::operator bool() const { return this->handle != nullptr; }
@@ -73,14 +92,12 @@ const std::string &DlLibrary::get_last_error(void) const {
     return this->last_error;
 }
 
-// symbol names are almost always short enough to trigger SSO
-// NOLINTNEXTLINE(performance-unnecessary-value-param)
-void *DlLibrary::get_symbol_pointer(const std::string name) const {
+void *DlLibrary::get_symbol_pointer(const char *name) const {
     if (this->handle == nullptr) {
         return nullptr;
     }
     log_trace("dlsym({})", name);
-    void *sym = ::dlsym(this->handle, name.c_str());
+    void *sym = ::dlsym(this->handle, name);
     if (sym == nullptr) {
         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
         const_cast<std::string &>(this->last_error).assign(::dlerror());
@@ -89,4 +106,58 @@ void *DlLibrary::get_symbol_pointer(const std::string name) const {
     return sym;
 }
 
+bool DlLibrary::get_symbol_pointers(std::span<const char *const> names,
+                                    std::span<void *> pointers) const {
+    if (this->handle == nullptr) {
+        return false;
+    }
+
+    struct link_map *map = nullptr;
+    autocompat_gnu_hash table{};
+    if (::dlinfo(this->handle, RTLD_DI_LINKMAP, static_cast<void *>(&map)) !=
+            0 ||
+        !autocompat_gnu_hash_init(&table, map)) {
+        map = nullptr;
+    }
+
+    bool found = true;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const ElfW(Sym) *sym =
+            map ? autocompat_gnu_hash_lookup(&table, names[i]) : nullptr;
+        if (sym && ELF64_ST_TYPE(sym->st_info) != STT_GNU_IFUNC &&
+            ELF64_ST_TYPE(sym->st_info) != STT_TLS) {
+            // NOLINTNEXTLINE(performance-no-int-to-ptr)
+            pointers[i] = reinterpret_cast<void *>(map->l_addr + sym->st_value);
+        } else {
+            pointers[i] = this->get_symbol_pointer(names[i]);
+        }
+        found = found && pointers[i] != nullptr;
+    }
+    return found;
+}
+
+const DlLibrary *DlLibraryCache::open(const std::filesystem::path &lib_path) {
+    struct stat lib_stat{};
+    if (::stat(lib_path.c_str(), &lib_stat) != 0) {
+        log_trace("stat({}): {}", lib_path, std::strerror(errno));
+        return nullptr;
+    }
+    const auto key = std::make_pair(lib_stat.st_dev, lib_stat.st_ino);
+
+    {
+        const std::lock_guard<std::mutex> lock(this->mutex);
+        const auto cached = this->libraries.find(key);
+        if (cached != this->libraries.end()) {
+            log_trace("dlopen({}): cached", lib_path);
+            return &cached->second;
+        }
+    }
+
+    // Should another thread load the same library meanwhile then this
+    // handle is simply dropped again in favor of the first one stored
+    DlLibrary lib{lib_path};
+    const std::lock_guard<std::mutex> lock(this->mutex);
+    return &this->libraries.try_emplace(key, std::move(lib)).first->second;
+}
+
 } // namespace autocompat
@@ -15,22 +15,30 @@
 #ifndef CUDA_AUTOCOMPAT_SEARCH_DL_LIBRARY_H
 #define CUDA_AUTOCOMPAT_SEARCH_DL_LIBRARY_H
 
+#include <array>
+#include <cstring>
 #include <filesystem>
-#include <functional>
+#include <map>
+#include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <sys/types.h>
 
 namespace autocompat {
 
 class DlLibrary {
   public:
     DlLibrary(const DlLibrary &) = delete;
-    DlLibrary &operator=(DlLibrary &) = delete;
-    DlLibrary(DlLibrary &&) = delete;
-    DlLibrary &operator=(DlLibrary &&) = delete;
+    DlLibrary &operator=(const DlLibrary &) = delete;
 
     DlLibrary(void) = default;
     explicit DlLibrary(const std::filesystem::path &lib_path);
+    DlLibrary(DlLibrary &&other) noexcept;
+    DlLibrary &operator=(DlLibrary &&other) noexcept;
     ~DlLibrary(void);
 
     explicit operator bool() const;
@@ -44,31 +52,95 @@ class DlLibrary {
     const std::string &get_last_error(void) const;
 
     template <typename T>
-    const T *get_data_symbol(const std::string name) const;
+    const T *get_data_symbol(const char *name) const;
 
+    // The symbol as a plain function pointer; nullptr if it isn't found
     template <typename TReturn, typename... TArgs>
-    auto get_function_symbol(const std::string name) const;
+    auto get_function_symbol(const char *name) const -> TReturn (*)(TArgs...);
+
+    // Resolve several symbols at once, each into a data or function pointer,
+    // i.e.:
+    //
+    //   const int *version = nullptr;
+    //   int (*get_version)(int &) = nullptr;
+    //   lib.get_symbols({"version", "get_version"}, version, get_version);
+    //
+    // Symbols the library defines itself are looked up in a single pass over
+    // its DT_GNU_HASH table rather than a dlsym call each, falling back to
+    // dlsym for IFUNC and TLS symbols and for anything found elsewhere.
+    //
+    // return:
+    //   true if all were found; false otherwise with the missing ones set to
+    //   nullptr
+    template <typename... TSymbols>
+    bool get_symbols(const std::array<const char *, sizeof...(TSymbols)> &names,
+                     TSymbols *&...symbols) const;
 
   private:
-    void *get_symbol_pointer(const std::string name) const;
+    void *get_symbol_pointer(const char *name) const;
+
+    bool get_symbol_pointers(std::span<const char *const> names,
+                             std::span<void *> pointers) const;
+
+    template <typename T>
+    static void from_pointer(void *ptr, T *&symbol);
 
     void *handle = nullptr;
     std::string last_error;
 };
 
 template <typename T>
-const T *DlLibrary::get_data_symbol(const std::string name) const {
+const T *DlLibrary::get_data_symbol(const char *name) const {
     return static_cast<T *>(this->get_symbol_pointer(name));
 }
 
 template <typename TReturn, typename... TArgs>
-auto DlLibrary::get_function_symbol(const std::string name) const {
-    const union {
-        void *ptr;
-        TReturn (*fptr)(TArgs...);
-    } symbol = {.ptr = this->get_symbol_pointer(name)};
+auto DlLibrary::get_function_symbol(const char *name) const
+    -> TReturn (*)(TArgs...) {
+    TReturn (*symbol)(TArgs...) = nullptr;
+    from_pointer(this->get_symbol_pointer(name), symbol);
+    return symbol;
+}
+
+template <typename... TSymbols>
+bool DlLibrary::get_symbols(
+    const std::array<const char *, sizeof...(TSymbols)> &names,
+    TSymbols *&...symbols) const {
+    std::array<void *, sizeof...(TSymbols)> pointers{};
+    const bool found = this->get_symbol_pointers(names, pointers);
+    size_t i = 0;
+    (from_pointer(pointers[i++], symbols), ...);
+    return found;
+}
 
-    return std::function<TReturn(TArgs...)>{symbol.fptr};
+template <typename T>
+void DlLibrary::from_pointer(void *ptr, T *&symbol) {
+    if constexpr (std::is_function_v<T>) {
+        // Object to function pointer casts aren't portable but POSIX
+        // guarantees they have the same representation
+        static_assert(sizeof(symbol) == sizeof(ptr));
+        std::memcpy(static_cast<void *>(&symbol), &ptr, sizeof(ptr));
+    } else {
+        symbol = static_cast<T *>(ptr);
+    }
 }
+
+// Libraries opened by file identity, so one reached through several paths,
+// i.e. symlinked toolkit or driver directories, is only loaded once.
+// Libraries stay loaded for the cache's lifetime and lookups may come from
+// multiple threads, though the dlopen itself happens without the lock held
+// so a library that hangs while loading doesn't block the others.
+class DlLibraryCache {
+  public:
+    // return:
+    //   The library, which may have failed to load; see DlLibrary::operator
+    //   bool and get_last_error.  nullptr if lib_path doesn't exist.
+    const DlLibrary *open(const std::filesystem::path &lib_path);
+
+  private:
+    std::mutex mutex;
+    std::map<std::pair<dev_t, ino_t>, DlLibrary> libraries;
+};
+
 } // namespace autocompat
 #endif // CUDA_AUTOCOMPAT_SEARCH_DL_LIBRARY_H
@@ -0,0 +1,301 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert((AUTOCOMPAT_METRICS_MAGIC & 0xff) == AUTOCOMPAT_METRICS_FORMAT,
+               "The metrics magic has to end with the format version");
+_Static_assert(sizeof(autocompat_metrics) % sizeof(uint64_t) == 0,
+               "The metrics segment has to be an array of uint64_t");
+
+static const char *get_metrics_dir(void) {
+    const char *dir = secure_getenv(AUTOCOMPAT_METRICS_DIR_ENV);
+    if (!dir) {
+        dir = AUTOCOMPAT_METRICS_DEFAULT_DIR;
+    }
+    return dir[0] != '\0' ? dir : NULL;
+}
+
+// Check that the segment has the expected layout, adopting a new zero-filled
+// one
+static bool check_magic(autocompat_metrics *metrics) {
+    uint64_t magic = 0;
+    return __atomic_compare_exchange_n(&metrics->magic, &magic,
+                                       AUTOCOMPAT_METRICS_MAGIC, false,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED) ||
+           magic == AUTOCOMPAT_METRICS_MAGIC;
+}
+
+static autocompat_metrics *map_metrics(void) {
+    const char *dir = get_metrics_dir();
+    if (!dir) {
+        return NULL;
+    }
+    char path[PATH_MAX];
+    const uid_t uid = geteuid();
+    const int path_len =
+        snprintf(path, sizeof(path), "%s/" AUTOCOMPAT_METRICS_PREFIX "%u"
+                 AUTOCOMPAT_METRICS_SUFFIX, dir, (unsigned int)uid);
+    if (path_len < 0 || (size_t)path_len >= sizeof(path)) {
+        return NULL;
+    }
+
+    // Only a segment the user owns is used, so no one else can resize it
+    // under the mapping.  Any process sizes it, rather than just its
+    // creator, since growing it with zeros is harmless and the creator may
+    // not get to.
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR);
+    if (fd < 0 && errno == EEXIST) {
+        fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat metrics_stat;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &metrics_stat) == 0 && S_ISREG(metrics_stat.st_mode) &&
+        metrics_stat.st_uid == uid &&
+        (metrics_stat.st_mode & (S_IWGRP | S_IWOTH)) == 0 &&
+        (metrics_stat.st_size >= (off_t)sizeof(autocompat_metrics) ||
+         ftruncate(fd, (off_t)sizeof(autocompat_metrics)) == 0)) {
+        addr = mmap(NULL, sizeof(autocompat_metrics), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+    }
+    (void)close(fd);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    if (!check_magic(addr)) {
+        (void)munmap(addr, sizeof(autocompat_metrics));
+        return NULL;
+    }
+    return addr;
+}
+
+// The segment is mapped once per process and stays mapped until it exits
+static autocompat_metrics *get_metrics(void) {
+    static autocompat_metrics *metrics;
+    static bool mapped;
+    if (!__atomic_load_n(&mapped, __ATOMIC_ACQUIRE)) {
+        autocompat_metrics *new_metrics = map_metrics();
+        autocompat_metrics *expected = NULL;
+        if (new_metrics &&
+            !__atomic_compare_exchange_n(&metrics, &expected, new_metrics,
+                                         false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            (void)munmap(new_metrics, sizeof(autocompat_metrics));
+        }
+        __atomic_store_n(&mapped, true, __ATOMIC_RELEASE);
+    }
+    return __atomic_load_n(&metrics, __ATOMIC_ACQUIRE);
+}
+
+static void add(uint64_t *counter, uint64_t value) {
+    (void)__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void observe(autocompat_histogram *histogram, uint64_t elapsed_us) {
+    static const uint64_t bounds[AUTOCOMPAT_METRICS_BUCKET_COUNT - 1] =
+        AUTOCOMPAT_METRICS_BUCKET_BOUNDS_INIT;
+
+    int bucket = 0;
+    while (bucket < AUTOCOMPAT_METRICS_BUCKET_COUNT - 1 &&
+           elapsed_us > bounds[bucket]) {
+        ++bucket;
+    }
+    add(&histogram->buckets[bucket], 1);
+    add(&histogram->count, 1);
+    add(&histogram->sum_us, elapsed_us);
+}
+
+static void count_version(autocompat_metrics *metrics, int version) {
+    const uint64_t key = (uint64_t)(version > 0 ? version : 0) + 1;
+    for (int slot = 0; slot < AUTOCOMPAT_METRICS_VERSION_SLOTS; ++slot) {
+        uint64_t slot_key = 0;
+        if (__atomic_compare_exchange_n(&metrics->versions[slot].version,
+                                        &slot_key, key, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED) ||
+            slot_key == key) {
+            add(&metrics->versions[slot].count, 1);
+            return;
+        }
+    }
+    add(&metrics->other_versions, 1);
+}
+
+uint64_t autocompat_metrics_now_us(void) {
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+        return 0;
+    }
+    return ((uint64_t)now.tv_sec * 1000000U) +
+           ((uint64_t)now.tv_nsec / 1000U);
+}
+
+void autocompat_metrics_record_resolution(autocompat_metrics_loader loader,
+                                          autocompat_metrics_outcome outcome,
+                                          int version, uint64_t elapsed_us) {
+    autocompat_metrics *metrics = get_metrics();
+    if (!metrics || loader >= AUTOCOMPAT_METRICS_LOADER_COUNT ||
+        outcome >= AUTOCOMPAT_METRICS_OUTCOME_COUNT) {
+        return;
+    }
+    add(&metrics->resolutions[loader][outcome], 1);
+    observe(&metrics->resolution_time[loader], elapsed_us);
+    if (outcome != AUTOCOMPAT_METRICS_FAILED) {
+        count_version(metrics, version);
+    }
+}
+
+void autocompat_metrics_record_search(bool found, uint64_t probes,
+                                      uint64_t pruned, uint64_t elapsed_us) {
+    autocompat_metrics *metrics = get_metrics();
+    if (!metrics) {
+        return;
+    }
+    add(&metrics->searches, 1);
+    if (!found) {
+        add(&metrics->search_failures, 1);
+    }
+    add(&metrics->probes, probes);
+    add(&metrics->pruned, pruned);
+    observe(&metrics->search_time, elapsed_us);
+}
+
+// Get the uid a segment's file name is for; -1 if it isn't a segment's
+static long get_segment_uid(const char *name) {
+    const size_t prefix_len = strlen(AUTOCOMPAT_METRICS_PREFIX);
+    const size_t suffix_len = strlen(AUTOCOMPAT_METRICS_SUFFIX);
+    const size_t name_len = strlen(name);
+    if (name_len <= prefix_len + suffix_len ||
+        strncmp(name, AUTOCOMPAT_METRICS_PREFIX, prefix_len) != 0 ||
+        strcmp(name + name_len - suffix_len, AUTOCOMPAT_METRICS_SUFFIX) != 0) {
+        return -1;
+    }
+    long uid = 0;
+    for (const char *c = name + prefix_len; c < name + name_len - suffix_len;
+         ++c) {
+        if (*c < '0' || *c > '9' || uid > (long)UINT32_MAX) {
+            return -1;
+        }
+        uid = (uid * 10) + (*c - '0');
+    }
+    return uid;
+}
+
+// Take a snapshot of one user's segment
+static bool read_segment(int dir_fd, const char *name,
+                         autocompat_metrics *out) {
+    const long uid = get_segment_uid(name);
+    if (uid < 0) {
+        return false;
+    }
+    int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat metrics_stat;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &metrics_stat) == 0 && S_ISREG(metrics_stat.st_mode) &&
+        metrics_stat.st_uid == (uid_t)uid &&
+        metrics_stat.st_size >= (off_t)sizeof(autocompat_metrics)) {
+        addr = mmap(NULL, sizeof(autocompat_metrics), PROT_READ, MAP_SHARED,
+                    fd, 0);
+    }
+    (void)close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const uint64_t *src = addr;
+    uint64_t *dst = (uint64_t *)out;
+    for (size_t i = 0; i < sizeof(*out) / sizeof(uint64_t); ++i) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+    (void)munmap(addr, sizeof(autocompat_metrics));
+    return out->magic == AUTOCOMPAT_METRICS_MAGIC;
+}
+
+// Add a segment's counters to the totals, matching up the version slots
+static void add_segment(autocompat_metrics *total,
+                        const autocompat_metrics *segment) {
+    const size_t first = offsetof(autocompat_metrics, resolutions);
+    const size_t last = offsetof(autocompat_metrics, versions);
+    const uint64_t *src = (const uint64_t *)segment;
+    uint64_t *dst = (uint64_t *)total;
+    for (size_t i = first / sizeof(uint64_t); i < last / sizeof(uint64_t);
+         ++i) {
+        dst[i] += src[i];
+    }
+
+    total->other_versions += segment->other_versions;
+    for (int src_slot = 0; src_slot < AUTOCOMPAT_METRICS_VERSION_SLOTS;
+         ++src_slot) {
+        const uint64_t key = segment->versions[src_slot].version;
+        if (key == 0) {
+            continue;
+        }
+        int slot = 0;
+        while (slot < AUTOCOMPAT_METRICS_VERSION_SLOTS &&
+               total->versions[slot].version != 0 &&
+               total->versions[slot].version != key) {
+            ++slot;
+        }
+        if (slot == AUTOCOMPAT_METRICS_VERSION_SLOTS) {
+            total->other_versions += segment->versions[src_slot].count;
+            continue;
+        }
+        total->versions[slot].version = key;
+        total->versions[slot].count += segment->versions[src_slot].count;
+    }
+}
+
+bool autocompat_metrics_read(autocompat_metrics *out) {
+    (void)memset(out, 0, sizeof(*out));
+    const char *dir_path = get_metrics_dir();
+    if (!dir_path) {
+        return false;
+    }
+
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return true;
+    }
+    const struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        autocompat_metrics segment;
+        if (read_segment(dirfd(dir), entry->d_name, &segment)) {
+            add_segment(out, &segment);
+        }
+    }
+    (void)closedir(dir);
+    out->magic = AUTOCOMPAT_METRICS_MAGIC;
+    return true;
+}
@@ -0,0 +1,132 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CUDA_AUTOCOMPAT_UTILS_METRICS_METRICS_H
+#define CUDA_AUTOCOMPAT_UTILS_METRICS_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Node-wide counters for every process using the loader libraries and the
+// helper, kept in small files in shared memory that each one maps and
+// updates with atomic adds, i.e. without any locking or system calls beyond
+// the mapping.  The helper's --metrics mode adds them up and renders them
+// for node_exporter's textfile collector.
+//
+// Each user has their own segment, cuda-autocompat-<uid>.stats, only they
+// can write to, since any other user able to write to it could also
+// truncate it and crash every process with it mapped.  The segments are in
+// AUTOCOMPAT_METRICS_DEFAULT_DIR unless the environment variable below gives
+// another directory, where an empty one disables metrics.
+#define AUTOCOMPAT_METRICS_DIR_ENV "CUDA_AUTOCOMPAT_METRICS_DIR"
+#define AUTOCOMPAT_METRICS_DEFAULT_DIR "/dev/shm"
+#define AUTOCOMPAT_METRICS_PREFIX "cuda-autocompat-"
+#define AUTOCOMPAT_METRICS_SUFFIX ".stats"
+
+// "CACMETR" followed by the format version, which changes with the layout
+#define AUTOCOMPAT_METRICS_MAGIC 0x4341434d45545201ULL
+#define AUTOCOMPAT_METRICS_FORMAT 1
+
+typedef enum {
+    AUTOCOMPAT_METRICS_AUDIT,
+    AUTOCOMPAT_METRICS_IFUNC,
+    AUTOCOMPAT_METRICS_LOADER_COUNT
+} autocompat_metrics_loader;
+
+// How a loader library resolved the driver
+typedef enum {
+    AUTOCOMPAT_METRICS_PINNED,   // The admin configuration's pin
+    AUTOCOMPAT_METRICS_CACHED,   // An ancestor's resolved token
+    AUTOCOMPAT_METRICS_SEARCHED, // The helper
+    AUTOCOMPAT_METRICS_FAILED,   // No usable driver
+    AUTOCOMPAT_METRICS_OUTCOME_COUNT
+} autocompat_metrics_outcome;
+
+// Upper bounds of the latency histogram buckets in microseconds, with a
+// final bucket for everything slower
+#define AUTOCOMPAT_METRICS_BUCKET_BOUNDS_INIT                                 \
+    {100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000,    \
+     10000000}
+#define AUTOCOMPAT_METRICS_BUCKET_COUNT 12
+
+// The number of distinct driver versions counted individually, with any
+// more counted together
+#define AUTOCOMPAT_METRICS_VERSION_SLOTS 16
+
+// Histogram bucket counts aren't cumulative
+typedef struct {
+    uint64_t buckets[AUTOCOMPAT_METRICS_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum_us;
+} autocompat_histogram;
+
+// Every field is a uint64_t so the segment can be read and updated as an
+// array of them.  A zero-filled segment is a valid one with nothing counted.
+typedef struct {
+    uint64_t magic;
+
+    // Indexed by autocompat_metrics_loader and then autocompat_metrics_outcome
+    uint64_t resolutions[AUTOCOMPAT_METRICS_LOADER_COUNT]
+                        [AUTOCOMPAT_METRICS_OUTCOME_COUNT];
+    autocompat_histogram resolution_time[AUTOCOMPAT_METRICS_LOADER_COUNT];
+
+    uint64_t searches;
+    uint64_t search_failures;
+    uint64_t probes;
+    uint64_t pruned;
+    autocompat_histogram search_time;
+
+    // Drivers selected by the loader libraries by cuDriverGetVersion, where
+    // 0 is unknown, i.e. pinned.  Slots are claimed by the first process to
+    // select each version.
+    struct {
+        uint64_t version; // The version plus one; 0 for an unclaimed slot
+        uint64_t count;
+    } versions[AUTOCOMPAT_METRICS_VERSION_SLOTS];
+    uint64_t other_versions;
+} autocompat_metrics;
+
+// return:
+//   A monotonic timestamp in microseconds for measuring latencies
+uint64_t autocompat_metrics_now_us(void);
+
+// Count a loader library's driver resolution, which took elapsed_us from the
+// time the process needed the driver.  version is the selected driver's if
+// the outcome isn't AUTOCOMPAT_METRICS_FAILED.
+void autocompat_metrics_record_resolution(autocompat_metrics_loader loader,
+                                          autocompat_metrics_outcome outcome,
+                                          int version, uint64_t elapsed_us);
+
+// Count one of the helper's searches
+void autocompat_metrics_record_search(bool found, uint64_t probes,
+                                      uint64_t pruned, uint64_t elapsed_us);
+
+// Take a snapshot of the totals of every user's segment the caller can
+// read, i.e. all of them as root, without creating any.  Segments that are
+// invalid or not owned by the user they're named for are skipped.
+//
+// return:
+//   true on success, where no segments read as all zeros; false if metrics
+//   are disabled
+bool autocompat_metrics_read(autocompat_metrics *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUDA_AUTOCOMPAT_UTILS_METRICS_METRICS_H
@@ -0,0 +1,129 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmark of the audit library's la_objsearch and la_objopen
+// callbacks, which run for every library a process loads.  The audit library
+// is linked directly so the callbacks can be called without the dynamic
+// linker.  An optional argument gives the number of iterations.
+
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The sonames and paths a large framework process, i.e. PyTorch, searches
+// for and opens, including a few driver libraries
+static const char *const names[] = {
+    "libc.so.6",
+    "libm.so.6",
+    "libdl.so.2",
+    "libpthread.so.0",
+    "librt.so.1",
+    "libgcc_s.so.1",
+    "libstdc++.so.6",
+    "libz.so.1",
+    "libgomp.so.1",
+    "libtorch.so",
+    "libtorch_cpu.so",
+    "libtorch_cuda.so",
+    "libtorch_python.so",
+    "libc10.so",
+    "libc10_cuda.so",
+    "libshm.so",
+    "libcudart.so.12",
+    "libcublas.so.12",
+    "libcublasLt.so.12",
+    "libcufft.so.11",
+    "libcurand.so.10",
+    "libcusparse.so.12",
+    "libcusolver.so.11",
+    "libcudnn.so.9",
+    "libnccl.so.2",
+    "libnvrtc.so.12",
+    "libnvJitLink.so.12",
+    "libnvToolsExt.so.1",
+    "libcupti.so.12",
+    "libpython3.12.so.1.0",
+    "libcuda.so.1",
+    "libnvidia-ml.so.1",
+    "libnvidia-ptxjitcompiler.so.1",
+    "/usr/lib64/libcrypto.so.3",
+};
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+static double now_ns(void) {
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    if (iterations <= 0) {
+        fputs("error: Invalid iteration count\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    (void)la_version(LAV_CURRENT);
+
+    // Each name is searched for as requested and then in a couple of
+    // directories, the way the dynamic linker walks its search path
+    char search_paths[NUM_NAMES][2][PATH_MAX];
+    for (size_t i = 0; i < NUM_NAMES; ++i) {
+        (void)snprintf(search_paths[i][0], PATH_MAX, "/opt/app/lib/%s",
+                       names[i]);
+        (void)snprintf(search_paths[i][1], PATH_MAX, "/usr/lib64/%s",
+                       names[i]);
+    }
+
+    // Open every name at the path the search settled on, redirected or not
+    struct link_map maps[NUM_NAMES];
+    (void)memset(maps, 0, sizeof(maps));
+    uintptr_t cookie = 0;
+    for (size_t i = 0; i < NUM_NAMES; ++i) {
+        char *found = la_objsearch(names[i], &cookie, LA_SER_ORIG);
+        maps[i].l_name = found != names[i] ? found : search_paths[i][1];
+    }
+
+    size_t redirected = 0;
+    double start = now_ns();
+    for (long n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < NUM_NAMES; ++i) {
+            redirected +=
+                la_objsearch(names[i], &cookie, LA_SER_ORIG) != names[i];
+            (void)la_objsearch(search_paths[i][0], &cookie, LA_SER_RUNPATH);
+            (void)la_objsearch(search_paths[i][1], &cookie, LA_SER_DEFAULT);
+        }
+    }
+    double search_ns = (now_ns() - start) / ((double)iterations * NUM_NAMES * 3);
+
+    size_t bound = 0;
+    start = now_ns();
+    for (long n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < NUM_NAMES; ++i) {
+            bound += la_objopen(&maps[i], LM_ID_BASE, &cookie) != 0;
+        }
+    }
+    double open_ns = (now_ns() - start) / ((double)iterations * NUM_NAMES);
+
+    printf("la_objsearch: %.1f ns/call (%zu redirected)\n", search_ns,
+           redirected / (size_t)iterations);
+    printf("la_objopen: %.1f ns/call (%zu bound)\n", open_ns,
+           bound / (size_t)iterations);
+    return EXIT_SUCCESS;
+}
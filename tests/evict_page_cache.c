@@ -0,0 +1,82 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Cold-cache mode for the startup benchmarks:
+//
+//   evict_page_cache DIR... -- COMMAND [ARGS...]
+//
+// drops every regular file in each DIR from the page cache and then execs
+// COMMAND, so everything it does from its first instruction on, including
+// an audit library's early search and prefetch, starts from a cold cache.
+// Files are written back first since dirty pages are never dropped, i.e.
+// for a copy just made, and it needs no privileges unlike writing to
+// /proc/sys/vm/drop_caches.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int evict_dir(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        return 0;
+    }
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        int fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        (void)fdatasync(fd);
+        if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0) {
+            ++count;
+        }
+        (void)close(fd);
+    }
+    (void)closedir(dir);
+    return count;
+}
+
+int main(int argc, char **argv) {
+    int separator = 1;
+    while (separator < argc && strcmp(argv[separator], "--") != 0) {
+        ++separator;
+    }
+    if (separator == 1 || separator + 1 >= argc) {
+        fprintf(stderr, "usage: %s DIR... -- COMMAND [ARGS...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int count = 0;
+    for (int i = 1; i < separator; ++i) {
+        count += evict_dir(argv[i]);
+    }
+    printf("Evicted %d files\n", count);
+    fflush(stdout);
+
+    execv(argv[separator + 1], &argv[separator + 1]);
+    perror(argv[separator + 1]);
+    return EXIT_FAILURE;
+}
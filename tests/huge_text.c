@@ -0,0 +1,103 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Reports how much of the driver's text is backed by huge pages, from the
+// AnonHugePages and FilePmdMapped counts of the mappings covering it in
+// /proc/self/smaps, after calling into it.  The argument is the path of the
+// driver's libcuda.so.1, which the audit library or IFUNC shim loaded.
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int cuDriverGetVersion(int *version);
+
+typedef struct {
+    ElfW(Addr) base;
+    uintptr_t start;
+    uintptr_t end;
+} text_range;
+
+static int find_text(struct dl_phdr_info *info, size_t size, void *data) {
+    (void)size;
+    text_range *text = data;
+    if (info->dlpi_addr != text->base) {
+        return 0;
+    }
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+            text->start = info->dlpi_addr + phdr->p_vaddr;
+            text->end = text->start + phdr->p_memsz;
+            break;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s LIBCUDA_PATH\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int version = 0;
+    int ret = cuDriverGetVersion(&version);
+    printf("cuDriverGetVersion: %d ver = %d\n", ret, version);
+
+    void *driver = dlopen(argv[1], RTLD_LAZY | RTLD_NOLOAD);
+    struct link_map *map = NULL;
+    if (!driver || dlinfo(driver, RTLD_DI_LINKMAP, &map) != 0) {
+        fprintf(stderr, "%s: not loaded\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    text_range text = {map->l_addr, 0, 0};
+    (void)dl_iterate_phdr(find_text, &text);
+
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) {
+        perror("/proc/self/smaps");
+        return EXIT_FAILURE;
+    }
+    unsigned long huge_kb = 0;
+    bool in_text = false;
+    char line[512];
+    while (fgets(line, sizeof(line), smaps)) {
+        uintptr_t start = 0;
+        uintptr_t end = 0;
+        unsigned long kb = 0;
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+            in_text = start < text.end && end > text.start;
+        } else if (in_text &&
+                   (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                    sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1)) {
+            huge_kb += kb;
+        }
+    }
+    (void)fclose(smaps);
+
+    // The driver still works from its new pages
+    ret = cuDriverGetVersion(&version);
+    printf("cuDriverGetVersion: %d ver = %d\n", ret, version);
+    printf("text: %lu kB\n", (unsigned long)((text.end - text.start) / 1024));
+    printf("huge: %lu kB\n", huge_kb);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Call the driver API through the IFUNC shim, which this is linked against
+// as its libcuda.so.1, and report which driver each call ended up in
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int cuInit(unsigned int flags);
+int cuDriverGetVersion(int *ver);
+int cuDeviceGetCount(int *count);
+int cuDeviceTotalMem_v2(size_t *bytes, int dev);
+int cuStreamQuery(void *stream);
+int cuStreamQuery_ptsz(void *stream);
+int cuModuleLoadData(void **module, const void *image);
+int cuProfilerStart(void);
+
+// Whether the driver's JIT compiler library is loaded
+static int jit_loaded(void) {
+    void *handle = dlopen("libnvidia-ptxjitcompiler.so.1", RTLD_LAZY | RTLD_NOLOAD);
+    if (handle) {
+        (void)dlclose(handle);
+    }
+    return handle != NULL;
+}
+
+int main(int argc, char **argv) {
+    // Like any other tool's --help, don't touch the GPU at all
+    if (argc > 1 && strcmp(argv[1], "--help") == 0) {
+        printf("usage: %s [--help]\n", argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    int ret = cuInit(0);
+    printf("cuInit: %d\n", ret);
+
+    int ver = -1;
+    ret = cuDriverGetVersion(&ver);
+    printf("cuDriverGetVersion: %d ver = %d\n", ret, ver);
+
+    int count = -1;
+    ret = cuDeviceGetCount(&count);
+    printf("cuDeviceGetCount: %d count = %d\n", ret, count);
+
+    size_t bytes = 0;
+    ret = cuDeviceTotalMem_v2(&bytes, 0);
+    printf("cuDeviceTotalMem_v2: %d bytes = %zu\n", ret, bytes);
+
+    printf("cuStreamQuery: %d\n", cuStreamQuery(NULL));
+    printf("cuStreamQuery_ptsz: %d\n", cuStreamQuery_ptsz(NULL));
+
+    // The JIT libraries are only loaded once the driver asks for them
+    printf("JIT loaded: %d\n", jit_loaded());
+    void *module = NULL;
+    printf("cuModuleLoadData: %d\n", cuModuleLoadData(&module, ""));
+    printf("JIT loaded: %d\n", jit_loaded());
+
+    // Calls bound to the shim's trampolines, i.e. when linked with -z now,
+    // are rebound straight to the driver once it's loaded
+    void *bound = NULL;
+    int (*get_count)(int *) = cuDeviceGetCount;
+    (void)memcpy(&bound, &get_count, sizeof(bound));
+    printf("cuDeviceGetCount: %s\n",
+           bound == dlsym(RTLD_DEFAULT, "cuDeviceGetCount") ? "direct"
+                                                             : "trampoline");
+
+    // Not implemented by the stub drivers
+    printf("cuProfilerStart: %d\n", cuProfilerStart());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmark of the IFUNC shim's memoized cuGetProcAddress_v2, which the
+// runtime fetches nearly every driver entry point through, repeating the
+// lookups a runtime makes as it initializes.  The stub driver counts the
+// lookups that reach it, so the difference is the number the shim saved.
+// An optional argument gives the number of iterations.
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int cuGetProcAddress_v2(const char *symbol, void **pfn, int cudaVersion,
+                        uint64_t flags, int *symbolStatus);
+
+#define CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM 0x2
+
+// Entry points the stub drivers have, one they don't, and the lookup itself
+static const char *const names[] = {
+    "cuInit",         "cuDriverGetVersion", "cuDeviceGetCount",
+    "cuDeviceTotalMem", "cuStreamQuery",    "cuGetProcAddress",
+    "cuMemAlloc",
+};
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+static double now_ns(void) {
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    if (iterations <= 0) {
+        fputs("error: Invalid iteration count\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    size_t found = 0;
+    double start = now_ns();
+    for (long n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < NUM_NAMES; ++i) {
+            for (uint64_t flags = 0;
+                 flags <= CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM;
+                 flags += CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM) {
+                void *pfn = NULL;
+                found += cuGetProcAddress_v2(names[i], &pfn, 12000, flags,
+                                             NULL) == 0;
+            }
+        }
+    }
+    size_t lookups = (size_t)iterations * NUM_NAMES * 2;
+    double lookup_ns = (now_ns() - start) / (double)lookups;
+
+    // The memoized answers still have to be the driver's
+    int (*total_mem)(size_t *, int) = NULL;
+    int (*stream_query)(void *) = NULL;
+    void *pfn = NULL;
+    (void)cuGetProcAddress_v2("cuDeviceTotalMem", &pfn, 12000, 0, NULL);
+    (void)memcpy(&total_mem, &pfn, sizeof(pfn));
+    (void)cuGetProcAddress_v2("cuStreamQuery", &pfn, 12000,
+                              CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM,
+                              NULL);
+    (void)memcpy(&stream_query, &pfn, sizeof(pfn));
+    size_t bytes = 0;
+    if (!total_mem || total_mem(&bytes, 0) != 0 || !stream_query) {
+        fputs("error: Lookup returned the wrong entry point\n", stderr);
+        return EXIT_FAILURE;
+    }
+    printf("cuDeviceTotalMem: bytes = %zu\n", bytes);
+    printf("cuStreamQuery_ptsz: %d\n", stream_query(NULL));
+
+    // The lookup itself resolves to the shim's so it stays memoized
+    (void)cuGetProcAddress_v2("cuGetProcAddress", &pfn, 12000, 0, NULL);
+    int (*self)(const char *, void **, int, uint64_t, int *) =
+        cuGetProcAddress_v2;
+    printf("cuGetProcAddress: %s\n",
+           memcmp(&pfn, &self, sizeof(pfn)) == 0 ? "shim" : "driver");
+
+    // Loaded into the global scope by the shim
+    unsigned long (*driver_calls)(void) = NULL;
+    void *sym = dlsym(RTLD_DEFAULT, "stub_proc_address_calls");
+    (void)memcpy(&driver_calls, &sym, sizeof(sym));
+    if (!driver_calls) {
+        fputs("error: The stub driver wasn't loaded\n", stderr);
+        return EXIT_FAILURE;
+    }
+    unsigned long forwarded = driver_calls();
+
+    printf("cuGetProcAddress_v2: %.1f ns/call (%zu found)\n", lookup_ns,
+           found / (size_t)iterations);
+    printf("%zu lookups, %lu forwarded, %zu saved\n", lookups + 3, forwarded,
+           lookups + 3 - forwarded);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Load libcuda.so.1 with a dlopen on a second thread, as libcudart does from
+// its initialization, then exec any arguments to check what the shim left in
+// the environment for child processes
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef int (*driver_get_version_fn)(int *);
+
+static void *load_driver(void *arg) {
+    (void)arg;
+    void *handle = dlopen("libcuda.so.1", RTLD_NOW);
+    if (!handle) {
+        fprintf(stderr, "dlopen: %s\n", dlerror());
+        return NULL;
+    }
+
+    driver_get_version_fn get_version;
+    void *sym = dlsym(handle, "cuDriverGetVersion");
+    memcpy(&get_version, &sym, sizeof(get_version));
+    int ver = -1;
+    if (get_version && get_version(&ver) == 0) {
+        printf("ver = %d\n", ver);
+    }
+    return handle;
+}
+
+int main(int argc, char **argv) {
+    pthread_t thread;
+    void *handle = NULL;
+    if (pthread_create(&thread, NULL, load_driver, NULL) != 0 ||
+        pthread_join(thread, &handle) != 0 || !handle) {
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 1) {
+        (void)fflush(stdout);
+        execvp(argv[1], argv + 1);
+        perror("execvp");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
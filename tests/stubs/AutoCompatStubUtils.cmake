@@ -44,16 +44,41 @@ function(_add_stub_toolkit_impl)
     endif()
 endfunction()
 
+function(_add_stub_driver_jit_libs)
+    if (NOT TARGET stub_driver_nvvm)
+        foreach(lib IN ITEMS nvvm.4 ptxjitcompiler.1)
+            string(REGEX REPLACE [=[^(.*)\.([0-9]+)$]=] [=[\1;\2]=] parts ${lib})
+            list(GET parts 0 name)
+            list(GET parts 1 soversion)
+            add_library(stub_driver_${name} SHARED
+                ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/cuda_jit.c
+            )
+            target_link_libraries(stub_driver_${name} PRIVATE utils_common)
+            set_target_properties(stub_driver_${name} PROPERTIES
+                OUTPUT_NAME nvidia-${name}
+                SOVERSION ${soversion}
+            )
+        endforeach()
+    endif()
+endfunction()
+
+# The JIT libraries are real, if empty, shared libraries with the driver's
+# sonames so they can be loaded, while the debugger library only needs to
+# exist
 function(_add_stub_driver_extra_libs TARGET_NAME)
+    _add_stub_driver_jit_libs()
+    add_dependencies(${TARGET_NAME} stub_driver_nvvm stub_driver_ptxjitcompiler)
     get_target_property(TARGET_DIR ${TARGET_NAME} LIBRARY_OUTPUT_DIRECTORY)
     add_custom_command(TARGET ${TARGET_NAME} POST_BUILD
         BYPRODUCTS
             ${TARGET_DIR}/libnvidia-nvvm.so.4
             ${TARGET_DIR}/libnvidia-ptxjitcompiler.so.1
             ${TARGET_DIR}/libcudadebugger.so.1
+        COMMAND ${CMAKE_COMMAND} -E copy
+            $<TARGET_FILE:stub_driver_nvvm>
+            $<TARGET_FILE:stub_driver_ptxjitcompiler>
+            ${TARGET_DIR}
         COMMAND ${CMAKE_COMMAND} -E touch
-            ${TARGET_DIR}/libnvidia-nvvm.so.4
-            ${TARGET_DIR}/libnvidia-ptxjitcompiler.so.1
             ${TARGET_DIR}/libcudadebugger.so.1
     )
 endfunction()
@@ -135,7 +160,7 @@ endfunction()
 
 function(add_stub_driver)
     set(options NOIMPL NOLINKS)
-    set(oneValueArgs TARGET VERSION)
+    set(oneValueArgs TARGET VERSION DELAY_MS INIT_DELAY_MS TEXT_MB)
     set(multiValueArgs)
     cmake_parse_arguments(PARSE_ARGV 0 arg
         "${options}" "${oneValueArgs}" "${multiValueArgs}"
@@ -150,15 +175,40 @@ function(add_stub_driver)
 
     _parse_cuda_ver(${arg_VERSION} c_version)
     add_library(${arg_TARGET} SHARED cuda_version.c)
+    if (arg_TEXT_MB)
+        target_compile_definitions(${arg_TARGET} PRIVATE
+            DRIVER_TEXT_MB=${arg_TEXT_MB}
+        )
+    endif()
     target_compile_definitions(${arg_TARGET} PRIVATE
         DRIVER_VERSION=${c_version}
     )
+    if (arg_DELAY_MS)
+        target_compile_definitions(${arg_TARGET} PRIVATE
+            DRIVER_DELAY_MS=${arg_DELAY_MS}
+        )
+    endif()
+    if (arg_INIT_DELAY_MS)
+        target_compile_definitions(${arg_TARGET} PRIVATE
+            DRIVER_INIT_DELAY_MS=${arg_INIT_DELAY_MS}
+        )
+    endif()
     target_link_libraries(${arg_TARGET} PRIVATE
         utils_common
     )
     if (NOT arg_NOIMPL)
         _add_stub_driver_impl()
-        target_link_libraries(${arg_TARGET} PRIVATE stub_driver_impl)
+        target_sources(${arg_TARGET} PRIVATE
+            ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/cuda_api.c
+        )
+        target_link_libraries(${arg_TARGET} PRIVATE
+            stub_driver_impl
+            ${CMAKE_DL_LIBS}
+        )
+
+        # cuGetProcAddress hands out the driver's own entry points rather
+        # than whatever the global scope, i.e. the IFUNC shim, exports
+        target_link_options(${arg_TARGET} PRIVATE -Wl,-Bsymbolic-functions)
     endif()
     set_target_properties(${arg_TARGET} PROPERTIES VERSION ${arg_VERSION})
 
@@ -0,0 +1,158 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This is part of a stub implementation of the CUDA driver library for testing.
+// A few driver API entry points, including versioned and per-thread default
+// stream variants, whose results identify the driver that implemented them.
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cuda_error.h"
+#include "visibility.h"
+
+#ifndef DRIVER_VERSION
+    #error "DRIVER_VERSION must be defined"
+#endif
+
+DLL_PUBLIC
+CUresult cuDeviceGetCount(int *count) {
+    if (count == NULL) {
+        return CUDA_ERROR_INVALID_VALUE;
+    }
+    *count = 1;
+    return CUDA_SUCCESS;
+}
+
+// Report the driver version as the device memory size
+DLL_PUBLIC
+CUresult cuDeviceTotalMem_v2(size_t *bytes, int dev) {
+    if (bytes == NULL || dev != 0) {
+        return CUDA_ERROR_INVALID_VALUE;
+    }
+    *bytes = DRIVER_VERSION;
+    return CUDA_SUCCESS;
+}
+
+DLL_PUBLIC
+CUresult cuStreamQuery(void *stream) {
+    (void)stream;
+    return CUDA_SUCCESS;
+}
+
+// Distinguishable from the legacy default stream variant above
+DLL_PUBLIC
+CUresult cuStreamQuery_ptsz(void *stream) {
+    (void)stream;
+    return CUDA_ERROR_NOT_READY;
+}
+
+// JIT compile the image, which for the stub is just loading the JIT library
+// by soname the way the real driver does and keeping it loaded
+DLL_PUBLIC
+CUresult cuModuleLoadData(void **module, const void *image) {
+    if (module == NULL) {
+        return CUDA_ERROR_INVALID_VALUE;
+    }
+    (void)image;
+    *module = dlopen("libnvidia-ptxjitcompiler.so.1", RTLD_LAZY);
+    return *module != NULL ? CUDA_SUCCESS : CUDA_ERROR_JIT_COMPILER_NOT_FOUND;
+}
+
+CUresult cuDriverGetVersion(int *ver);
+CUresult cuInit(unsigned int flags);
+CUresult cuGetProcAddress(const char *symbol, void **pfn, int cudaVersion,
+                          uint64_t flags);
+CUresult cuGetProcAddress_v2(const char *symbol, void **pfn, int cudaVersion,
+                             uint64_t flags, int *symbolStatus);
+
+#define CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM 0x2
+#define CU_GET_PROC_ADDRESS_SUCCESS 0
+#define CU_GET_PROC_ADDRESS_SYMBOL_NOT_FOUND 1
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+} entry_point;
+
+static entry_point entry_points[] = {
+    {"cuInit", (void (*)(void))cuInit},
+    {"cuDriverGetVersion", (void (*)(void))cuDriverGetVersion},
+    {"cuGetProcAddress", (void (*)(void))cuGetProcAddress},
+    {"cuGetProcAddress_v2", (void (*)(void))cuGetProcAddress_v2},
+    {"cuDeviceGetCount", (void (*)(void))cuDeviceGetCount},
+    {"cuDeviceTotalMem_v2", (void (*)(void))cuDeviceTotalMem_v2},
+    {"cuStreamQuery", (void (*)(void))cuStreamQuery},
+    {"cuStreamQuery_ptsz", (void (*)(void))cuStreamQuery_ptsz},
+};
+
+static void (*find_entry_point(const char *name))(void) {
+    for (size_t i = 0; i < sizeof(entry_points) / sizeof(entry_points[0]);
+         ++i) {
+        if (strcmp(entry_points[i].name, name) == 0) {
+            return entry_points[i].fn;
+        }
+    }
+    return NULL;
+}
+
+// Lets tests count the lookups that actually reached the driver
+static unsigned long proc_address_calls = 0;
+
+DLL_PUBLIC
+unsigned long stub_proc_address_calls(void) {
+    return __atomic_load_n(&proc_address_calls, __ATOMIC_RELAXED);
+}
+
+// Map the unversioned name to the variant for the requested version and
+// default stream semantics the way cuda.h does
+DLL_PUBLIC
+CUresult cuGetProcAddress_v2(const char *symbol, void **pfn, int cudaVersion,
+                             uint64_t flags, int *symbolStatus) {
+    if (symbol == NULL || pfn == NULL) {
+        return CUDA_ERROR_INVALID_VALUE;
+    }
+    __atomic_fetch_add(&proc_address_calls, 1, __ATOMIC_RELAXED);
+
+    char name[128];
+    void (*fn)(void) = NULL;
+    if ((flags & CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM) != 0 &&
+        snprintf(name, sizeof(name), "%s_ptsz", symbol) < (int)sizeof(name)) {
+        fn = find_entry_point(name);
+    }
+    if (fn == NULL && cudaVersion >= 3020 &&
+        snprintf(name, sizeof(name), "%s_v2", symbol) < (int)sizeof(name)) {
+        fn = find_entry_point(name);
+    }
+    if (fn == NULL) {
+        fn = find_entry_point(symbol);
+    }
+
+    (void)memcpy(pfn, &fn, sizeof(*pfn));
+    if (symbolStatus != NULL) {
+        *symbolStatus = fn != NULL ? CU_GET_PROC_ADDRESS_SUCCESS
+                                   : CU_GET_PROC_ADDRESS_SYMBOL_NOT_FOUND;
+    }
+    return fn != NULL ? CUDA_SUCCESS : CUDA_ERROR_NOT_FOUND;
+}
+
+DLL_PUBLIC
+CUresult cuGetProcAddress(const char *symbol, void **pfn, int cudaVersion,
+                          uint64_t flags) {
+    return cuGetProcAddress_v2(symbol, pfn, cudaVersion, flags, NULL);
+}
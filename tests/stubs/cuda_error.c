@@ -27,6 +27,15 @@ static const char string_success[] = "no error";
 static const char name_invalid[] = "CUDA_ERROR_INVALID_VALUE";
 static const char string_invalid[] = "invalid argument";
 
+static const char name_jit_not_found[] = "CUDA_ERROR_JIT_COMPILER_NOT_FOUND";
+static const char string_jit_not_found[] = "PTX JIT compiler library not found";
+
+static const char name_not_found[] = "CUDA_ERROR_NOT_FOUND";
+static const char string_not_found[] = "named symbol not found";
+
+static const char name_not_ready[] = "CUDA_ERROR_NOT_READY";
+static const char string_not_ready[] = "device not ready";
+
 static const char name_unknown[] = "CUDA_ERROR_UNKNOWN";
 static const char string_unknown[] = "unknown error";
 
@@ -41,6 +50,15 @@ static const char string_unknown[] = "unknown error";
     case CUDA_ERROR_INVALID_VALUE:            \
         *(pStr) = msg_type##_invalid;         \
         return CUDA_SUCCESS;                  \
+    case CUDA_ERROR_JIT_COMPILER_NOT_FOUND:   \
+        *(pStr) = msg_type##_jit_not_found;   \
+        return CUDA_SUCCESS;                  \
+    case CUDA_ERROR_NOT_FOUND:                \
+        *(pStr) = msg_type##_not_found;       \
+        return CUDA_SUCCESS;                  \
+    case CUDA_ERROR_NOT_READY:                \
+        *(pStr) = msg_type##_not_ready;       \
+        return CUDA_SUCCESS;                  \
     case CUDA_ERROR_UNKNOWN:                  \
         *(pStr) = msg_type##_unknown;         \
         return CUDA_SUCCESS;                  \
@@ -0,0 +1,25 @@
+/* Copyright 2025 Chuck Atkins and CUDA Auto-Compat contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This is part of a stub implementation of the CUDA driver library for testing.
+// Stands in for the driver's JIT libraries, libnvidia-nvvm.so.4 and
+// libnvidia-ptxjitcompiler.so.1, which the driver loads by soname on demand.
+
+#include "visibility.h"
+
+DLL_PUBLIC
+int stub_jit_version(void) {
+    return 1;
+}
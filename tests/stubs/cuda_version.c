@@ -16,6 +16,7 @@
 // This is part of a stub implementation of the CUDA driver library for testing.
 
 #include <stddef.h>
+#include <time.h>
 
 #include "cuda_error.h"
 #include "visibility.h"
@@ -26,12 +27,42 @@
 
 static const int driver_version = DRIVER_VERSION;
 
+#ifdef DRIVER_TEXT_MB
+    #define DRIVER_STR(x) DRIVER_STR_(x)
+    #define DRIVER_STR_(x) #x
+
+// Pad the text out to the size of a real driver's, which is large enough to
+// be backed by huge pages
+__asm__(".pushsection .text.stub_padding, \"ax\", %progbits\n"
+        ".skip " DRIVER_STR(DRIVER_TEXT_MB) " * 1024 * 1024\n"
+        ".popsection\n");
+#endif
+
+#ifdef DRIVER_INIT_DELAY_MS
+// Simulate a driver whose constructor hangs, which holds the dynamic
+// linker's lock for as long as it runs
+__attribute__((constructor)) static void driver_init(void) {
+    struct timespec delay = {DRIVER_INIT_DELAY_MS / 1000,
+                             (DRIVER_INIT_DELAY_MS % 1000) * 1000000L};
+    while (nanosleep(&delay, &delay) != 0) {
+    }
+}
+#endif
+
 DLL_PUBLIC
 CUresult cuDriverGetVersion(int *ver) {
     if (ver == NULL) {
         return CUDA_ERROR_INVALID_VALUE;
     }
 
+#ifdef DRIVER_DELAY_MS
+    // Simulate a driver on a hung or very slow filesystem
+    struct timespec delay = {DRIVER_DELAY_MS / 1000,
+                             (DRIVER_DELAY_MS % 1000) * 1000000L};
+    while (nanosleep(&delay, &delay) != 0) {
+    }
+#endif
+
     *ver = driver_version;
     return CUDA_SUCCESS;
 }
@@ -16,6 +16,8 @@
 // This is part of a stub implementation of the CUDA driver library for testing.
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <dlfcn.h>
 
 #include "cudart_error.h"
@@ -24,6 +26,41 @@
 static void * driver_handle = NULL;
 static int (*cuDriverGetVersion)(int *) = NULL;
 
+typedef int (*get_proc_address_fn)(const char *, void **, int, uint64_t,
+                                   int *);
+
+#define CU_GET_PROC_ADDRESS_DEFAULT 0x0
+#define CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM 0x2
+
+// Like the real runtime, fetch the driver entry points through
+// cuGetProcAddress_v2 for both default stream semantics up front
+static const char *const entry_points[] = {
+    "cuInit",
+    "cuDriverGetVersion",
+    "cuDeviceGetCount",
+    "cuDeviceTotalMem",
+    "cuStreamQuery",
+};
+
+static void *get_entry_points(get_proc_address_fn get_proc_address) {
+    void *driver_get_version = NULL;
+    const uint64_t flags[] = {CU_GET_PROC_ADDRESS_DEFAULT,
+                              CU_GET_PROC_ADDRESS_PER_THREAD_DEFAULT_STREAM};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); ++f) {
+        for (size_t i = 0; i < sizeof(entry_points) / sizeof(entry_points[0]);
+             ++i) {
+            void *pfn = NULL;
+            int status = 0;
+            if (get_proc_address(entry_points[i], &pfn, 12000, flags[f],
+                                 &status) == 0 &&
+                strcmp(entry_points[i], "cuDriverGetVersion") == 0) {
+                driver_get_version = pfn;
+            }
+        }
+    }
+    return driver_get_version;
+}
+
 int load_driver(void) {
     if (driver_handle != NULL) {
         return 1;
@@ -36,8 +73,14 @@ int load_driver(void) {
     union {
         void *ptr;
         int (*fptr)(int *);
+        get_proc_address_fn get_proc_address;
     } symbol;
-    symbol.ptr = dlsym(driver_handle, "cuDriverGetVersion");
+    symbol.ptr = dlsym(driver_handle, "cuGetProcAddress_v2");
+    if (symbol.ptr) {
+        symbol.ptr = get_entry_points(symbol.get_proc_address);
+    } else {
+        symbol.ptr = dlsym(driver_handle, "cuDriverGetVersion");
+    }
     if (symbol.ptr) {
         cuDriverGetVersion = symbol.fptr;
     }